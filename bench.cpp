@@ -0,0 +1,162 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+#include "src/gba.h"
+#include "src/utils/log.h"
+#include "src/utils/parse_utils.h"
+#include "src/utils/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+
+const uint64_t DEFAULT_FRAMES = 600;
+
+const char *const section_names[Profile_Sections] = { "cpu", "mmu", "lcd", "timer", "dma" };
+
+std::string escape_json(const std::string &text)
+{
+    std::string escaped;
+
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+int main(const int argc, const char *const *const argv)
+{
+    // Logs go to stderr, stdout only receives the JSON report
+    auto console = spdlog::stderr_color_mt("AmazinglyAdvanced");
+
+    spdlog::set_pattern("[%n] [%l] %v");
+
+    if (argc < 3)
+    {
+        console->error("Usage: {} BIOS ROM [--frames N] [--interpreter] [--jit] [--render-thread]", argv[0]);
+
+        return 1;
+    }
+
+    uint64_t frames = DEFAULT_FRAMES;
+    CPU_ENGINE engine = CPU_ENGINE::Cached;
+    RENDER_MODE render_mode = RENDER_MODE::Serial;
+
+    for (int i = 3; i < argc; i++)
+    {
+        std::string option = argv[i];
+
+        if (option == "--frames")
+        {
+            if (++i == argc || !parse_count(argv[i], frames))
+            {
+                console->error("Option --frames requires a number!");
+
+                return 3;
+            }
+        }
+        else if (option == "--interpreter")
+        {
+            engine = CPU_ENGINE::Interpreter;
+        }
+        else if (option == "--jit")
+        {
+            engine = CPU_ENGINE::Native;
+        }
+        else if (option == "--render-thread")
+        {
+            render_mode = RENDER_MODE::Threaded;
+        }
+        else
+        {
+            console->warn("Unknown option: {}", option);
+        }
+    }
+
+    std::unique_ptr<GBA> gba = std::make_unique<GBA>(argv[1], argv[2], true);
+
+    gba->set_cpu_engine(engine);
+    gba->set_render_mode(render_mode);
+    gba->set_frame_limit(frames);
+
+    // I/O register logging would dominate the measurement
+    spdlog::set_level(spdlog::level::off);
+
+    auto wall_start  = std::chrono::steady_clock::now();
+    uint64_t tsc_start = read_tsc();
+
+    try
+    {
+        gba->run();
+    }
+    catch (const std::runtime_error &e)
+    {
+        spdlog::set_level(spdlog::level::info);
+
+        console->error("Emulation stopped after {} frames: {}", gba->get_frame_count(), e.what());
+
+        return 2;
+    }
+
+    uint64_t tsc_end = read_tsc();
+    auto wall_end    = std::chrono::steady_clock::now();
+
+    double wall_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(wall_end - wall_start).count();
+    double ns_per_tick = wall_ns / (double)std::max<uint64_t>(tsc_end - tsc_start, 1);
+    double seconds = wall_ns / 1e9;
+
+    uint64_t emulated_frames = gba->get_frame_count();
+
+    fmt::print("{{\n");
+    fmt::print("  \"rom\": \"{}\",\n", escape_json(argv[2]));
+    fmt::print("  \"frames\": {},\n", emulated_frames);
+    fmt::print("  \"cycles\": {},\n", gba->get_cycles());
+    fmt::print("  \"instructions\": {},\n", profile_counters.instructions);
+    fmt::print("  \"wall_ns\": {:.0f},\n", wall_ns);
+    fmt::print("  \"ns_per_frame\": {:.1f},\n", wall_ns / (double)std::max<uint64_t>(emulated_frames, 1));
+    fmt::print("  \"frames_per_second\": {:.2f},\n", (double)emulated_frames / seconds);
+    fmt::print("  \"instructions_per_second\": {:.0f},\n", (double)profile_counters.instructions / seconds);
+    fmt::print("  \"sections\": {{\n");
+
+    for (size_t section = 0; section < Profile_Sections; section++)
+    {
+        uint64_t calls   = profile_counters.calls[section];
+        uint64_t samples = profile_counters.samples[section];
+
+        // Sampled sections only timed some calls, scale their time up to all calls
+        double ticks = (samples == 0) ? 0.0 :
+                       (double)profile_counters.ticks[section] * ((double)calls / (double)samples);
+        double ns = ticks * ns_per_tick;
+
+        fmt::print("    \"{}\": {{ \"ns\": {:.0f}, \"calls\": {}, \"sampled\": {}, \"share\": {:.4f} }}{}\n",
+                   section_names[section], ns, calls, (samples != calls) ? "true" : "false", ns / wall_ns,
+                   ((section + 1u) < Profile_Sections) ? "," : "");
+    }
+
+    fmt::print("  }}\n");
+    fmt::print("}}\n");
+
+    return 0;
+}
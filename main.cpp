@@ -18,8 +18,10 @@
 
 #include "src/gba.h"
 #include "src/utils/log.h"
+#include "src/utils/parse_utils.h"
 
 #include <memory>
+#include <string>
 
 int main(const int argc, const char *const *const argv)
 {
@@ -44,11 +46,135 @@ int main(const int argc, const char *const *const argv)
     }
     else
     {
+        CPU_ENGINE engine = CPU_ENGINE::Cached;
+        RENDER_MODE render_mode = RENDER_MODE::Serial;
+
+        bool headless = false;
+        bool idle_skip = true;
+        bool hle_swi = false;
+        bool predecode = true;
+        uint64_t frame_limit = 0;
+        uint64_t cycle_limit = 0;
+        const char *frame_hash_path = nullptr;
+        const char *dump_path = nullptr;
+        const char *idle_loop_path = nullptr;
+
+        for (int i = 3; i < argc; i++)
+        {
+            std::string option = argv[i];
+
+            if (option == "--interpreter")
+            {
+                engine = CPU_ENGINE::Interpreter;
+            }
+            else if (option == "--verify-blocks")
+            {
+                engine = CPU_ENGINE::Verified;
+            }
+            else if (option == "--jit")
+            {
+                engine = CPU_ENGINE::Native;
+            }
+            else if (option == "--jit-check")
+            {
+                engine = CPU_ENGINE::Native_Checked;
+            }
+            else if (option == "--render-thread")
+            {
+                render_mode = RENDER_MODE::Threaded;
+            }
+            else if (option == "--render-thread-deterministic")
+            {
+                render_mode = RENDER_MODE::Deterministic;
+            }
+            else if (option == "--headless")
+            {
+                headless = true;
+            }
+            else if (option == "--no-idle-skip")
+            {
+                idle_skip = false;
+            }
+            else if (option == "--hle-swi")
+            {
+                hle_swi = true;
+            }
+            else if (option == "--no-predecode")
+            {
+                predecode = false;
+            }
+            else if (option == "--frames" || option == "--cycles" || option == "--frame-hashes" ||
+                     option == "--dump-framebuffer" || option == "--idle-loops")
+            {
+                if (++i == argc)
+                {
+                    console->error("Option {} requires a value!", option);
+
+                    return 3;
+                }
+
+                if (option == "--frames" || option == "--cycles")
+                {
+                    if (!parse_count(argv[i], (option == "--frames") ? frame_limit : cycle_limit))
+                    {
+                        console->error("Option {} requires a number, got \"{}\"!", option, argv[i]);
+
+                        return 3;
+                    }
+                }
+                else if (option == "--frame-hashes")
+                {
+                    frame_hash_path = argv[i];
+                }
+                else if (option == "--idle-loops")
+                {
+                    idle_loop_path = argv[i];
+                }
+                else
+                {
+                    dump_path = argv[i];
+                }
+            }
+            else
+            {
+                console->warn("Unknown option: {}", option);
+            }
+        }
+
         try
         {
-            gba = std::make_unique<GBA>(argv[1], argv[2]);
+            // "-" runs without a BIOS image
+            const char *bios_path = (std::string(argv[1]) == "-") ? nullptr : argv[1];
+
+            gba = std::make_unique<GBA>(bios_path, argv[2], headless);
+            gba->set_cpu_engine(engine);
+            gba->set_render_mode(render_mode);
+            gba->set_idle_skip(idle_skip);
+            gba->set_predecode(predecode);
+            gba->set_frame_limit(frame_limit);
+            gba->set_cycle_limit(cycle_limit);
+
+            if (hle_swi)
+            {
+                gba->set_hle_swi(true);
+            }
+
+            if (idle_loop_path != nullptr)
+            {
+                gba->load_idle_loops(idle_loop_path);
+            }
+
+            if (frame_hash_path != nullptr)
+            {
+                gba->set_frame_hash_path(frame_hash_path);
+            }
 
             gba->run();
+
+            if (dump_path != nullptr)
+            {
+                gba->dump_framebuffer(dump_path);
+            }
         }
         catch (const std::runtime_error &e)
         {
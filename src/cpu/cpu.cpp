@@ -17,8 +17,17 @@
  */
 
 #include "cpu.h"
+#include "hle_decompress.h"
+#include "jit.h"
 
+#include "../interrupts/interrupts.h"
+#include "../mmu/cartridge/cartridge.h"
 #include "../mmu/mmu.h"
+#include "../scheduler/scheduler.h"
+#include "../utils/profiler.h"
+
+#include <algorithm>
+#include <cmath>
 
 constexpr uint32_t count_bits_set(const uint16_t value)
 {
@@ -35,6 +44,110 @@ constexpr uint32_t count_bits_set(const uint16_t value)
     return bits_set;
 }
 
+// Bit n of entry c is set if condition c passes with NZCV = n. Condition 0xF (NV) never passes on ARMv4
+constexpr std::array<uint16_t, 16> make_condition_table()
+{
+    std::array<uint16_t, 16> table = {};
+
+    for (uint32_t nzcv = 0; nzcv < 16; nzcv++)
+    {
+        bool n = (nzcv & 8u) != 0;
+        bool z = (nzcv & 4u) != 0;
+        bool c = (nzcv & 2u) != 0;
+        bool v = (nzcv & 1u) != 0;
+
+        const bool results[16] = {
+            z, !z, c, !c, n, !n, v, !v, c && !z, !c || z, n == v, n != v, !z && (n == v), z || (n != v), true, false
+        };
+
+        for (size_t c_code = 0; c_code < 16; c_code++)
+        {
+            if (results[c_code])
+            {
+                table[c_code] |= 1u << nzcv;
+            }
+        }
+    }
+
+    return table;
+}
+
+constexpr std::array<uint16_t, 16> condition_table = make_condition_table();
+
+// BIOS math runs on 32-bit registers, keep its wraparound without signed overflow
+constexpr int32_t multiply_wrap(const int32_t a, const int32_t b)
+{
+    return (int32_t)((uint32_t)a * (uint32_t)b);
+}
+
+// Sine table used by the BIOS affine SWIs, sin(2 * pi * i / 256) in 1.14 fixed point, truncated towards zero
+std::array<int16_t, 256> make_sine_table()
+{
+    constexpr double pi = 3.14159265358979323846;
+
+    std::array<int16_t, 256> table = {};
+
+    for (size_t i = 0; i < 256; i++)
+    {
+        table[i] = (int16_t)(std::sin((double)i * pi / 128.0) * 16384.0);
+    }
+
+    return table;
+}
+
+const std::array<int16_t, 256> sine_table = make_sine_table();
+
+// Polynomial the BIOS ArcTan evaluates, tan is in 1.14 fixed point. a and b are the last intermediates,
+// the BIOS leaves them in r1 and r3
+int32_t bios_arctan(const int32_t tan, int32_t &a, int32_t &b)
+{
+    a = -(multiply_wrap(tan, tan) >> 14);
+    b = (multiply_wrap(0xA9, a) >> 14) + 0x390;
+    b = (multiply_wrap(b, a) >> 14) + 0x91C;
+    b = (multiply_wrap(b, a) >> 14) + 0xFB6;
+    b = (multiply_wrap(b, a) >> 14) + 0x16AA;
+    b = (multiply_wrap(b, a) >> 14) + 0x2081;
+    b = (multiply_wrap(b, a) >> 14) + 0x3651;
+    b = (multiply_wrap(b, a) >> 14) + 0xA2F9;
+
+    return multiply_wrap(tan, b) >> 16;
+}
+
+int32_t bios_arctan2(const int32_t x, const int32_t y, int32_t &a, int32_t &b)
+{
+    if (y == 0)
+    {
+        return (x >= 0) ? 0 : 0x8000;
+    }
+
+    if (x == 0)
+    {
+        return (y >= 0) ? 0x4000 : 0xC000;
+    }
+
+    if (y >= 0)
+    {
+        if ((x >= 0 && x >= y) || (x < 0 && -x >= y))
+        {
+            return bios_arctan(multiply_wrap(y, 0x4000) / x, a, b) + ((x >= 0) ? 0 : 0x8000);
+        }
+
+        return 0x4000 - bios_arctan(multiply_wrap(x, 0x4000) / y, a, b);
+    }
+
+    if (x <= 0 && -x > -y)
+    {
+        return bios_arctan(multiply_wrap(y, 0x4000) / x, a, b) + 0x8000;
+    }
+
+    if (x > 0 && x >= -y)
+    {
+        return bios_arctan(multiply_wrap(y, 0x4000) / x, a, b) + 0x10000;
+    }
+
+    return 0xC000 - bios_arctan(multiply_wrap(x, 0x4000) / y, a, b);
+}
+
 constexpr uint32_t first_bit_set(const uint16_t value)
 {
     for (uint16_t i = 0; i < 16; i++)
@@ -49,23 +162,27 @@ constexpr uint32_t first_bit_set(const uint16_t value)
 }
 
 CPU::CPU(const std::shared_ptr<MMU> &mmu) :
-regs(), arm_inst(0), arm_op(0), thumb_inst(0), thumb_op(0)
+regs(), cycles(0), arm_inst(0), arm_op(0), thumb_inst(0), thumb_op(0), thumb_inst_fused(0), block_invalidated(false), engine(CPU_ENGINE::Cached),
+power_state(POWER_STATE::Power_Running), hle_swi(false), intr_wait_pending(false), idle_skip(true),
+predecode_thread(), predecode_done(false), predecode_pending(false), predecoded_blocks(), jit(), jit_exception(),
+jit_snapshot(), jit_snapshot_timestamp(0)
 {
     this->mmu = mmu;
+    this->mmu->cpu = this;
+    scheduler  = mmu->scheduler.get();
+    interrupts = mmu->interrupts.get();
     console = spdlog::stdout_color_mt("ARM7TDMI");
 
     regs.pc = 0x8000000;
     regs.cpsr.cpu_mode = CPU_MODE::System;
+    load_flags(regs.cpsr.cpsr);
+    regs.r[13] = 0x3007F00;
     regs.sp_banked[get_index(CPU_MODE::Supervisor)] = 0x3007FE0;
-    regs.sp_banked[get_index(CPU_MODE::IRQ)]    = 0x3007FA0;
-    regs.sp_banked[get_index(CPU_MODE::System)] = 0x3007F00;
+    regs.sp_banked[get_index(CPU_MODE::IRQ)] = 0x3007FA0;
 
     state_table[0] = &CPU::decode_arm;
     state_table[1] = &CPU::decode_thumb;
 
-    fill_arm_table();
-    fill_thumb_table();
-
     /*console->info("  r0: {:08X}h   r1: {:08X}h   r2: {:08X}h   r3: {:08X}h",
             get_register(0), get_register(1), get_register(2), get_register(3));
     console->info("  r4: {:08X}h   r5: {:08X}h   r6: {:08X}h   r7: {:08X}h",
@@ -79,199 +196,192 @@ regs(), arm_inst(0), arm_op(0), thumb_inst(0), thumb_op(0)
 }
 
 CPU::~CPU()
-= default;
-
-void CPU::fill_arm_table()
 {
-    for (uint32_t i = 0; i < 4096; i++)
+    if (predecode_thread.joinable())
     {
-        arm_table[i] = &CPU::undefined_instruction;
+        predecode_thread.join();
     }
+}
+
+// Maps an index built from bits 27-20 and 7-4 of an ARM instruction to a handler specialized on those bits
+template <uint32_t index>
+constexpr CPU::Handler CPU::get_arm_handler()
+{
+    constexpr bool bit_25 = (index & 0x200u) != 0;
+    constexpr bool bit_24 = (index & 0x100u) != 0;
+    constexpr bool bit_23 = (index & 0x80u) != 0;
+    constexpr bool bit_22 = (index & 0x40u) != 0;
+    constexpr bool bit_21 = (index & 0x20u) != 0;
+    constexpr bool bit_20 = (index & 0x10u) != 0;
 
-    for (uint32_t i = 0; i <= 0x3FF; i++)
+    if constexpr (index == 0x109 || index == 0x149)
     {
-        arm_table[i] = &CPU::arm_data_processing;
+        return &CPU::arm_single_data_swap<bit_22>;
     }
-
-    arm_table[0x121] = &CPU::arm_branch_and_exchange;
-
+    else if constexpr ((index & 0xF8Fu) == 0x89)
     {
-        uint32_t pu = 0;
-        uint32_t wl = 0;
-        uint32_t sh = 0;
-
-        while (pu < 4)
-        {
-            uint32_t i = 0b000000001001u | pu << 7u | wl << 4u | sh << 1u;
-
-            arm_table[i] = &CPU::arm_halfword_data_transfer;
-            arm_table[i | 0x40u] = &CPU::arm_halfword_data_transfer;
-
-            ++sh;
-
-            if (sh == 4)
-            {
-                ++wl;
-                sh = 0;
-            }
-
-            if (wl == 4)
-            {
-                ++pu;
-                wl = 0;
-            }
-        }
+        return &CPU::arm_multiply_long<bit_22, bit_21, bit_20>;
     }
-
-    for (uint16_t i = 0x9; i <= 0x39; i += 0x10)
+    else if constexpr ((index & 0xFCFu) == 0x9)
     {
-        arm_table[i] = &CPU::arm_multiply;
+        return &CPU::arm_multiply<bit_21, bit_20>;
     }
-
-    for (uint16_t i = 0x89; i <= 0xF9; i += 0x10)
+    else if constexpr ((index & 0xE09u) == 0x9)
     {
-        arm_table[i] = &CPU::arm_multiply_long;
+        return &CPU::arm_halfword_data_transfer<bit_24, bit_23, bit_22, bit_21, bit_20, (index >> 1u) & 3u>;
     }
-
-    arm_table[0x109] = &CPU::arm_single_data_swap;
-    arm_table[0x149] = &CPU::arm_single_data_swap;
-
-    for (uint32_t i = 0x400; i <= 0x7FF; i++)
+    else if constexpr (index == 0x121)
     {
-        arm_table[i] = &CPU::arm_single_data_transfer;
+        return &CPU::arm_branch_and_exchange;
     }
-
-    for (uint32_t i = 0x800; i <= 0x9FF; i++)
+    else if constexpr (index <= 0x3FF)
     {
-        arm_table[i] = &CPU::arm_block_data_transfer;
+        // Immediate operands ignore the shift bits, so they share one handler per opcode
+        return &CPU::arm_data_processing<bit_25, (index >> 5u) & 0xFu, bit_20, (bit_25) ? 0 : index & 0xFu>;
     }
-
-    for (uint32_t i = 0xA00; i <= 0xBFF; i++)
+    else if constexpr (index <= 0x7FF)
     {
-        arm_table[i] = &CPU::arm_branch;
+        return &CPU::arm_single_data_transfer<bit_25, bit_24, bit_23, bit_22, bit_21, bit_20,
+                                              (bit_25) ? (index >> 1u) & 3u : 0>;
     }
-
-    for (uint32_t i = 0xF00; i <= 0xFFF; i++)
+    else if constexpr (index <= 0x9FF)
+    {
+        return &CPU::arm_block_data_transfer<bit_24, bit_23, bit_22, bit_21, bit_20>;
+    }
+    else if constexpr (index <= 0xBFF)
+    {
+        return &CPU::arm_branch<bit_24>;
+    }
+    else if constexpr (index >= 0xF00)
     {
-        arm_table[i] = &CPU::software_interrupt;
+        return &CPU::software_interrupt;
     }
+    else
+    {
+        return &CPU::undefined_instruction;
+    }
+}
+
+template <size_t... indices>
+constexpr std::array<CPU::Handler, 4096> CPU::make_arm_table(std::index_sequence<indices...>)
+{
+    return {{ get_arm_handler<indices>()... }};
 }
 
-void CPU::fill_thumb_table()
+// Shared by all CPU instances, built during constant initialization
+const std::array<CPU::Handler, 4096> CPU::arm_table = CPU::make_arm_table(std::make_index_sequence<4096>());
+
+// Maps bits 15-6 of a Thumb instruction to a handler specialized on the opcode bits they contain
+template <uint32_t index>
+constexpr CPU::Handler CPU::get_thumb_handler()
 {
-    for (uint32_t i = 0; i < 256; i++)
+    constexpr uint32_t op8 = index >> 2u;
+    constexpr bool bit_12  = (index & 0x40u) != 0;
+    constexpr bool bit_11  = (index & 0x20u) != 0;
+    constexpr bool bit_10  = (index & 0x10u) != 0;
+    constexpr bool bit_9   = (index & 0x8u) != 0;
+    constexpr bool bit_8   = (index & 0x4u) != 0;
+    constexpr bool bit_7   = (index & 0x2u) != 0;
+    constexpr bool bit_6   = (index & 0x1u) != 0;
+
+    if constexpr (op8 <= 0x17)
     {
-        thumb_table[i] = &CPU::undefined_instruction;
+        return &CPU::thumb_move_shifted_register<(index >> 5u) & 3u>;
     }
-
-    for (uint32_t i = 0; i <= 0x1F; i++)
+    else if constexpr (op8 <= 0x1F)
     {
-        thumb_table[i] = &CPU::thumb_move_shifted_register;
+        return &CPU::thumb_add<bit_10, bit_9>;
     }
-
-    for (uint32_t i = 0x18; i <= 0x1F; i++)
+    else if constexpr (op8 <= 0x3F)
     {
-        thumb_table[i] = &CPU::thumb_add;
+        return &CPU::thumb_move_immediate<(index >> 5u) & 3u>;
     }
-
-    for (uint32_t i = 0x20; i <= 0x3F; i++)
+    else if constexpr (op8 <= 0x43)
     {
-        thumb_table[i] = &CPU::thumb_move_immediate;
+        return &CPU::thumb_alu<index & 0xFu>;
     }
-
-    for (uint32_t i = 0x40; i <= 0x43; i++)
+    else if constexpr (op8 <= 0x47)
     {
-        thumb_table[i] = &CPU::thumb_alu;
+        return &CPU::thumb_hi_register<(index >> 2u) & 3u, bit_7, bit_6>;
     }
-
-    for (uint32_t i = 0x44; i <= 0x47; i++)
+    else if constexpr (op8 <= 0x4F)
     {
-        thumb_table[i] = &CPU::thumb_hi_register;
+        return &CPU::thumb_pc_relative_load;
     }
-
-    for (uint32_t i = 0x48; i <= 0x4F; i++)
+    else if constexpr (op8 <= 0x5F && !bit_9)
     {
-        thumb_table[i] = &CPU::thumb_pc_relative_load;
+        return &CPU::thumb_load_register_offset<bit_11, bit_10>;
     }
-
+    else if constexpr (op8 <= 0x5F)
     {
-        uint32_t lb = 0;
-        uint32_t a  = 0;
-
-        while (lb < 4)
-        {
-            uint32_t i = 0b01010000u | (lb << 2u) | a;
-
-            thumb_table[i] = &CPU::thumb_load_register_offset;
-            thumb_table[i | 2u] = &CPU::thumb_load_signed_halfword;
-            ++a;
-
-            if (a == 2)
-            {
-                ++lb;
-                a = 0;
-            }
-        }
+        return &CPU::thumb_load_signed_halfword<(uint32_t)bit_11 | (uint32_t)bit_10 << 1u>;
     }
-
-    for (uint32_t i = 0x60; i <= 0x7F; i++)
+    else if constexpr (op8 <= 0x7F)
     {
-        thumb_table[i] = &CPU::thumb_load_immediate_offset;
+        return &CPU::thumb_load_immediate_offset<bit_12, bit_11>;
     }
-
-    for (uint32_t i = 0x80; i <= 0x8F; i++)
+    else if constexpr (op8 <= 0x8F)
     {
-        thumb_table[i] = &CPU::thumb_load_halfword;
+        return &CPU::thumb_load_halfword<bit_11>;
     }
-
-    for (uint32_t i = 0x90; i <= 0x9F; i++)
+    else if constexpr (op8 <= 0x9F)
     {
-        thumb_table[i] = &CPU::thumb_sp_relative_load;
+        return &CPU::thumb_sp_relative_load<bit_11>;
     }
-
-    for (uint32_t i = 0xA0; i <= 0xAF; i++)
+    else if constexpr (op8 <= 0xAF)
     {
-        thumb_table[i] = &CPU::thumb_load_address;
+        return &CPU::thumb_load_address<bit_11>;
     }
-
-    thumb_table[0b10110000] = &CPU::thumb_add_offset_to_sp;
-
-    thumb_table[0b10110100] = &CPU::thumb_push_registers;
-    thumb_table[0b10110101] = &CPU::thumb_push_registers;
-    thumb_table[0b10111100] = &CPU::thumb_push_registers;
-    thumb_table[0b10111101] = &CPU::thumb_push_registers;
-
-    for (uint32_t i = 0xC0; i <= 0xCF; i++)
+    else if constexpr (op8 == 0xB0)
     {
-        thumb_table[i] = &CPU::thumb_multiple_load;
+        return &CPU::thumb_add_offset_to_sp<bit_7>;
     }
-
-    for (uint32_t i = 0xD0; i <= 0xDF; i++)
+    else if constexpr (op8 == 0xB4 || op8 == 0xB5 || op8 == 0xBC || op8 == 0xBD)
     {
-        thumb_table[i] = &CPU::thumb_conditional_branch;
+        return &CPU::thumb_push_registers<bit_11, bit_8>;
     }
-
-    thumb_table[0b11011111] = &CPU::software_interrupt;
-
-    for (uint32_t i = 0xE0; i <= 0xE7; i++)
+    else if constexpr (op8 >= 0xC0 && op8 <= 0xCF)
     {
-        thumb_table[i] = &CPU::thumb_unconditional_branch;
+        return &CPU::thumb_multiple_load<bit_11, op8 & 7u>;
     }
-
-    for (uint32_t i = 0xF0; i <= 0xFF; i++)
+    else if constexpr (op8 >= 0xD0 && op8 <= 0xDE)
+    {
+        return &CPU::thumb_conditional_branch<op8 & 0xFu>;
+    }
+    else if constexpr (op8 == 0xDF)
+    {
+        return &CPU::software_interrupt;
+    }
+    else if constexpr (op8 >= 0xE0 && op8 <= 0xE7)
+    {
+        return &CPU::thumb_unconditional_branch;
+    }
+    else if constexpr (op8 >= 0xF0)
+    {
+        return &CPU::thumb_long_branch<bit_11>;
+    }
+    else
     {
-        thumb_table[i] = &CPU::thumb_long_branch;
+        return &CPU::undefined_instruction;
     }
 }
 
+template <size_t... indices>
+constexpr std::array<CPU::Handler, 1024> CPU::make_thumb_table(std::index_sequence<indices...>)
+{
+    return {{ get_thumb_handler<indices>()... }};
+}
+
+const std::array<CPU::Handler, 1024> CPU::thumb_table = CPU::make_thumb_table(std::make_index_sequence<1024>());
+
 std::string CPU::get_cpsr_flags() const
 {
     std::string flags = "       ";
 
-    flags[0] = (regs.cpsr.negative)    ? 'N' : '-';
-    flags[1] = (regs.cpsr.zero)        ? 'Z' : '-';
-    flags[2] = (regs.cpsr.carry)       ? 'C' : '-';
-    flags[3] = (regs.cpsr.overflow)    ? 'V' : '-';
+    flags[0] = (get_negative())        ? 'N' : '-';
+    flags[1] = (get_zero())            ? 'Z' : '-';
+    flags[2] = (get_carry())           ? 'C' : '-';
+    flags[3] = (get_overflow())        ? 'V' : '-';
     flags[4] = (regs.cpsr.irq_disable) ? 'I' : '-';
     flags[5] = (regs.cpsr.fiq_disable) ? 'F' : '-';
     flags[6] = (regs.cpsr.thumb_state) ? 'T' : '-';
@@ -387,7 +497,7 @@ uint32_t CPU::get_pc_prefetch() const
 
 uint32_t CPU::get_cpsr() const
 {
-    return regs.cpsr.cpsr;
+    return (regs.cpsr.cpsr & 0xFFFFFFFu) | (get_nzcv() << 28u);
 }
 
 uint32_t CPU::get_spsr() const
@@ -404,30 +514,12 @@ uint32_t CPU::get_spsr() const
 
 uint32_t CPU::get_register(const uint8_t index) const
 {
-    if (index < 8)
-    {
-        return regs.r_unbanked[index];
-    }
-    else if (index < 13)
-    {
-        return regs.r_banked_fiq[index - 8u][(regs.cpsr.cpu_mode == CPU_MODE::FIQ) ? 1 : 0];
-    }
-    else if (index == 13)
-    {
-        return regs.sp_banked[get_index((CPU_MODE)regs.cpsr.cpu_mode)];
-    }
-    else if (index == 14)
-    {
-        return regs.lr_banked[get_index((CPU_MODE)regs.cpsr.cpu_mode)];
-    }
-    else if (index == 15)
+    if (index == 15)
     {
         return get_pc_prefetch();
     }
 
-    console->error("Invalid register index: {}", index);
-
-    throw std::runtime_error("Invalid register index!");
+    return regs.r[index];
 }
 
 void CPU::set_cpsr(const uint32_t value, const bool privileged)
@@ -438,7 +530,11 @@ void CPU::set_cpsr(const uint32_t value, const bool privileged)
     {
         //console->warn("Privileged CPSR access!");
 
+        set_cpu_mode((CPU_MODE)(value & 0x1Fu));
+
         regs.cpsr.cpsr = value;
+        load_flags(value);
+        interrupts->set_irq_disable(regs.cpsr.irq_disable);
 
         /*
         if (((old_cpsr & 0x20u) != 0) != regs.cpsr.thumb_state)
@@ -459,6 +555,7 @@ void CPU::set_cpsr(const uint32_t value, const bool privileged)
         //console->info("Unprivileged CPSR access");
 
         regs.cpsr.cpsr = (regs.cpsr.cpsr & 0xFFFFFFFu) | (value & 0xF0000000u);
+        load_flags(value);
     }
 }
 
@@ -490,109 +587,177 @@ void CPU::set_cpu_state(const bool thumb)
 
 void CPU::set_register(const uint8_t index, const uint32_t value)
 {
-    if (index < 8)
+    if (index == 15)
     {
-        regs.r_unbanked[index] = value;
+        regs.pc = value;
+        refill_pipeline();
         return;
     }
-    else if (index < 13)
+
+    regs.r[index] = value;
+}
+
+void CPU::set_cpu_mode(const CPU_MODE mode)
+{
+    bank_registers((CPU_MODE)regs.cpsr.cpu_mode, mode);
+
+    regs.cpsr.cpu_mode = mode;
+}
+
+// Saves the banked registers of the old mode and loads the ones of the new mode into the active set
+void CPU::bank_registers(const CPU_MODE old_mode, const CPU_MODE new_mode)
+{
+    uint8_t old_index = get_index(old_mode);
+    uint8_t new_index = get_index(new_mode);
+
+    if (old_index == new_index)
     {
-        regs.r_banked_fiq[index - 8u][(regs.cpsr.cpu_mode == CPU_MODE::FIQ) ? 1 : 0] = value;
         return;
     }
-    else if (index == 13)
+
+    if ((old_mode == CPU_MODE::FIQ) || (new_mode == CPU_MODE::FIQ))
     {
-        regs.sp_banked[get_index((CPU_MODE)regs.cpsr.cpu_mode)] = value;
-        return;
+        for (uint8_t i = 0; i < 5; i++)
+        {
+            regs.r_banked_fiq[i][(old_mode == CPU_MODE::FIQ) ? 1 : 0] = regs.r[8u + i];
+            regs.r[8u + i] = regs.r_banked_fiq[i][(new_mode == CPU_MODE::FIQ) ? 1 : 0];
+        }
+    }
+
+    regs.sp_banked[old_index] = regs.r[13];
+    regs.lr_banked[old_index] = regs.r[14];
+    regs.r[13] = regs.sp_banked[new_index];
+    regs.r[14] = regs.lr_banked[new_index];
+}
+
+bool CPU::get_negative() const
+{
+    return (regs.flags.n & 0x80000000u) != 0;
+}
+
+bool CPU::get_zero() const
+{
+    return regs.flags.z == 0;
+}
+
+bool CPU::get_carry() const
+{
+    switch (regs.flags.cv)
+    {
+        case FLAGS_CV::Flags_Add:
+            return (0xFFFFFFFFu - regs.flags.a) < regs.flags.b;
+        case FLAGS_CV::Flags_Sub:
+            return regs.flags.a >= regs.flags.b;
+        default:
+            return regs.flags.carry;
     }
-    else if (index == 14)
+}
+
+bool CPU::get_overflow() const
+{
+    uint32_t a = regs.flags.a;
+    uint32_t b = regs.flags.b;
+    uint32_t result = regs.flags.result;
+
+    switch (regs.flags.cv)
     {
-        regs.lr_banked[get_index((CPU_MODE)regs.cpsr.cpu_mode)] = value;
-        return;
+        case FLAGS_CV::Flags_Add:
+            return ((a ^ b) & 0x80000000u) == 0 && ((a ^ result) & 0x80000000u) != 0;
+        case FLAGS_CV::Flags_Sub:
+            return ((a ^ b) & 0x80000000u) != 0 && ((a ^ result) & 0x80000000u) != 0;
+        default:
+            return regs.flags.overflow;
     }
-    else if (index == 15)
+}
+
+uint32_t CPU::get_nzcv() const
+{
+    return ((uint32_t)get_negative() << 3u) | ((uint32_t)get_zero() << 2u) | ((uint32_t)get_carry() << 1u) |
+           (uint32_t)get_overflow();
+}
+
+void CPU::set_carry(const bool carry)
+{
+    // V has to survive a shifter carry out
+    if (regs.flags.cv != FLAGS_CV::Flags_Stored)
     {
-        regs.pc = value;
-        return;
+        regs.flags.overflow = get_overflow();
+        regs.flags.cv = FLAGS_CV::Flags_Stored;
     }
 
-    console->error("Invalid register index: {}", index);
+    regs.flags.carry = carry;
+}
 
-    throw std::runtime_error("Invalid register index!");
+void CPU::load_flags(const uint32_t value)
+{
+    regs.flags.n = value & 0x80000000u;
+    regs.flags.z = ~value & 0x40000000u;
+    regs.flags.cv = FLAGS_CV::Flags_Stored;
+    regs.flags.carry = (value & 0x20000000u) != 0;
+    regs.flags.overflow = (value & 0x10000000u) != 0;
 }
 
 void CPU::set_nz(const uint32_t value)
 {
-    regs.cpsr.negative = (value & 0x80000000u) != 0;
-    regs.cpsr.zero = value == 0;
+    regs.flags.n = value;
+    regs.flags.z = value;
 }
 
 void CPU::set_nz_long(const uint64_t value)
 {
-    regs.cpsr.negative = (value & 0x8000000000000000u) != 0;
-    regs.cpsr.zero = value == 0;
+    regs.flags.n = value >> 32u;
+    regs.flags.z = (uint32_t)(value >> 32u) | (uint32_t)value;
 }
 
 void CPU::set_nzcv_add(const uint32_t a, const uint32_t b, const uint32_t result)
 {
     set_nz(result);
 
-    regs.cpsr.carry = (0xFFFFFFFFu - a) < b;
-    regs.cpsr.overflow = ((a ^ b) & 0x80000000u) == 0 && ((a ^ result) & 0x80000000u) != 0;
+    regs.flags.cv = FLAGS_CV::Flags_Add;
+    regs.flags.a = a;
+    regs.flags.b = b;
+    regs.flags.result = result;
 }
 
 void CPU::set_nzcv_sub(const uint32_t a, const uint32_t b, const uint32_t result)
 {
     set_nz(result);
 
-    regs.cpsr.carry = a >= b;
-    regs.cpsr.overflow = ((a ^ b) & 0x80000000u) != 0 && ((a ^ result) & 0x80000000u) != 0;
+    regs.flags.cv = FLAGS_CV::Flags_Sub;
+    regs.flags.a = a;
+    regs.flags.b = b;
+    regs.flags.result = result;
+}
+
+bool CPU::is_condition(const uint8_t c_code) const
+{
+    return ((condition_table[c_code] >> get_nzcv()) & 1u) != 0;
 }
 
-bool CPU::is_condition(const uint8_t c_code)
+// Condition check right after CMP a, b, without going through the flags
+bool CPU::is_condition_sub(const uint32_t a, const uint32_t b, const uint8_t c_code) const
 {
     switch (c_code)
     {
-        case 0b0000:
-            return regs.cpsr.zero;
-        case 0b0001:
-            return !regs.cpsr.zero;
-        case 0b0010:
-            return regs.cpsr.carry;
-        case 0b0011:
-            return !regs.cpsr.carry;
-        case 0b0100:
-            return regs.cpsr.negative;
-        case 0b0101:
-            return !regs.cpsr.negative;
-        case 0b0110:
-            return regs.cpsr.overflow;
-        case 0b0111:
-            return !regs.cpsr.overflow;
-        case 0b1000:
-            return regs.cpsr.carry && !regs.cpsr.zero;
-        case 0b1001:
-            return !regs.cpsr.carry || regs.cpsr.zero;
-        case 0b1010:
-            return (regs.cpsr.negative && regs.cpsr.overflow) || (!regs.cpsr.negative && !regs.cpsr.overflow);
-        case 0b1011:
-            return (regs.cpsr.negative && !regs.cpsr.overflow) || (!regs.cpsr.negative && regs.cpsr.overflow);
-        case 0b1100:
-            return !regs.cpsr.zero && ((regs.cpsr.negative && regs.cpsr.overflow) || (!regs.cpsr.negative && !regs.cpsr.overflow));
-        case 0b1101:
-            return regs.cpsr.zero || (regs.cpsr.negative && !regs.cpsr.overflow) || (!regs.cpsr.negative && regs.cpsr.overflow);
-        case 0b1110:
-            return true;
-        case 0b1111:
+        case 0b0000: return a == b;
+        case 0b0001: return a != b;
+        case 0b0010: return a >= b;
+        case 0b0011: return a < b;
+        case 0b1000: return a > b;
+        case 0b1001: return a <= b;
+        case 0b1010: return (int32_t)a >= (int32_t)b;
+        case 0b1011: return (int32_t)a < (int32_t)b;
+        case 0b1100: return (int32_t)a > (int32_t)b;
+        case 0b1101: return (int32_t)a <= (int32_t)b;
         default:
-            console->error("Invalid/reserved condition!");
-
-            throw std::runtime_error("Invalid/reserved condition!");
+            return is_condition(c_code);
     }
 }
 
 void CPU::load_register(const uint8_t rd, const uint32_t address, const bool byte)
 {
+    cycles += mmu->get_access_cycles(address, false, !byte) + 1u;
+
     if (byte)
     {
         set_register(rd, mmu->read8(address));
@@ -609,6 +774,8 @@ void CPU::load_register(const uint8_t rd, const uint32_t address, const bool byt
 
 void CPU::store_register(const uint8_t rd, const uint32_t address, const bool byte)
 {
+    cycles += mmu->get_access_cycles(address, false, !byte);
+
     if (byte)
     {
         //console->info("strb r{}, ${:08X}", rd, address);
@@ -631,10 +798,92 @@ uint32_t CPU::read_word(const uint32_t address) const
     return (word >> offset) | (word << (32u - offset));
 }
 
+void CPU::refill_pipeline()
+{
+    bool word = !regs.cpsr.thumb_state;
+
+    cycles += mmu->get_access_cycles(regs.pc, false, word) + mmu->get_access_cycles(regs.pc, true, word);
+}
+
+uint32_t CPU::multiply_cycles(const uint32_t multiplier) const
+{
+    // Early termination: one internal cycle per significant byte of the multiplier
+    if ((multiplier & 0xFFFFFF00u) == 0 || (multiplier & 0xFFFFFF00u) == 0xFFFFFF00u)
+    {
+        return 1;
+    }
+    else if ((multiplier & 0xFFFF0000u) == 0 || (multiplier & 0xFFFF0000u) == 0xFFFF0000u)
+    {
+        return 2;
+    }
+    else if ((multiplier & 0xFF000000u) == 0 || (multiplier & 0xFF000000u) == 0xFF000000u)
+    {
+        return 3;
+    }
+
+    return 4;
+}
+
+uint32_t CPU::block_transfer_cycles(const uint32_t address, const uint32_t count) const
+{
+    // An empty register list still transfers one word
+    uint32_t sequential = (count != 0) ? count - 1u : 0;
+
+    return mmu->get_access_cycles(address, false, true) + sequential * mmu->get_access_cycles(address, true, true);
+}
+
+// Block transfers of r0-r14 within one mapped page move words straight between the register file and host
+// memory. Returns false if the regular accessors have to be used
+bool CPU::load_multiple_fast(const uint32_t address, const uint16_t rlist)
+{
+    const uint8_t *host = ((address & 3u) == 0) ? mmu->get_read_block(address, count_bits_set(rlist) * 4u) : nullptr;
+
+    if (host == nullptr)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < 15; i++)
+    {
+        if ((rlist & (1u << i)) != 0)
+        {
+            regs.r[i] = *(const uint32_t*)host;
+
+            host += 4u;
+        }
+    }
+
+    return true;
+}
+
+bool CPU::store_multiple_fast(const uint32_t address, const uint16_t rlist)
+{
+    uint8_t *host = ((address & 3u) == 0) ? mmu->get_write_block(address, count_bits_set(rlist) * 4u) : nullptr;
+
+    if (host == nullptr)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < 15; i++)
+    {
+        if ((rlist & (1u << i)) != 0)
+        {
+            *(uint32_t*)host = regs.r[i];
+
+            host += 4u;
+        }
+    }
+
+    return true;
+}
+
 uint32_t CPU::fetch_arm()
 {
     uint32_t instruction = mmu->read32(get_pc());
 
+    cycles += mmu->get_access_cycles(get_pc(), true, true);
+
     regs.pc += 4u;
 
     return instruction;
@@ -644,6 +893,8 @@ uint16_t CPU::fetch_thumb()
 {
     uint16_t instruction = mmu->read16(get_pc());
 
+    cycles += mmu->get_access_cycles(get_pc(), true, false);
+
     regs.pc += 2u;
 
     return instruction;
@@ -665,35 +916,924 @@ void CPU::decode_arm()
 void CPU::decode_thumb()
 {
     thumb_inst = fetch_thumb();
-    thumb_op   = thumb_inst >> 8u;
+    thumb_op   = thumb_inst >> 6u;
 
     (this->*thumb_table[thumb_op])();
 }
 
-uint32_t CPU::barrel_shifter(const bool immediate, const bool set_c, const uint16_t operand, const bool dp)
+bool CPU::is_interrupt_pending() const
 {
-    uint8_t rm     = operand & 0xFu;
-    uint32_t value = get_register(rm);
-    uint8_t amount = ((immediate) ? (operand >> 7u) : get_register(operand >> 8u));
-    auto mode      = (uint8_t)((operand >> 5u) & 3u);
+    return interrupts->is_irq_pending();
+}
 
-    if (dp && (rm == 15 && !immediate))
+// Interrupts wake the CPU up even if IME or the CPSR I bit block them
+bool CPU::is_wake_up_pending() const
+{
+    uint16_t pending = interrupts->get_pending();
+
+    if (power_state == POWER_STATE::Power_Stop)
+    {
+        pending &= INTERRUPT::Interrupt_Serial | INTERRUPT::Interrupt_Keypad | INTERRUPT::Interrupt_GamePak;
+    }
+
+    return pending != 0;
+}
+
+bool CPU::is_block_end_arm(const uint32_t instruction) const
+{
+    bool rd_is_pc = ((instruction >> 12u) & 0xFu) == 15;
+
+    switch ((instruction >> 25u) & 7u)
+    {
+        case 0b000:
+            // BX, data processing and halfword loads
+            return rd_is_pc || (instruction & 0x0FFFFFF0u) == 0x012FFF10u;
+        case 0b001:
+        case 0b010:
+        case 0b011:
+            return rd_is_pc;
+        case 0b100:
+            // LDM with r15 in the list or an empty list
+            return (instruction & 0x8000u) != 0 || (instruction & 0xFFFFu) == 0;
+        default:
+            // Branches, coprocessor instructions and SWI
+            return true;
+    }
+}
+
+bool CPU::is_block_end_thumb(const uint16_t instruction) const
+{
+    switch (instruction >> 12u)
+    {
+        case 0b0100:
+            // Hi register operations with rd = r15, and BX
+            return (instruction & 0xFC00u) == 0x4400u && ((instruction & 0x87u) == 0x87u || (instruction & 0x300u) == 0x300u);
+        case 0b1011:
+            // POP {..., pc}
+            return (instruction & 0xFF00u) == 0xBD00u;
+        case 0b1100:
+            // LDMIA with an empty list
+            return (instruction & 0x8FFu) == 0x800u;
+        case 0b1101:
+        case 0b1110:
+            return true;
+        case 0b1111:
+            // Second half of BL
+            return (instruction & 0x800u) != 0;
+        default:
+            return false;
+    }
+}
+
+Block *CPU::get_block()
+{
+    uint32_t address = regs.pc & 0x0FFFFFFFu;
+    uint32_t region  = address >> 24u;
+    uint32_t key     = regs.pc | (uint32_t)regs.cpsr.thumb_state;
+
+    // Only code in the BIOS, WRAM and Game Pak ROM is cached
+    if (!((region == 0 && address < 0x4000) || region == 2 || region == 3 || (region >= 8 && region < 0xE)))
+    {
+        return nullptr;
+    }
+
+    auto cached = block_cache.find(key);
+
+    if (cached != block_cache.end())
+    {
+        return &cached->second;
+    }
+
+    if (predecode_pending && predecode_done.load(std::memory_order_acquire))
+    {
+        merge_predecoded_blocks();
+
+        cached = block_cache.find(key);
+
+        if (cached != block_cache.end())
+        {
+            return &cached->second;
+        }
+    }
+
+    Block &block = block_cache[key];
+
+    block.address = regs.pc;
+    block.thumb   = regs.cpsr.thumb_state;
+
+    compile_block(block);
+
+    if (region == 2)
+    {
+        code_pages[0x2000000u | (address & 0x3FFFFu & ~CODE_PAGE_MASK)].push_back(key);
+        mmu->set_code_page(address);
+    }
+    else if (region == 3)
+    {
+        code_pages[0x3000000u | (address & 0x7FFFu & ~CODE_PAGE_MASK)].push_back(key);
+        mmu->set_code_page(address);
+    }
+
+    return &block;
+}
+
+// Decodes instructions from block.address up to the end of the block, fetch(address, thumb) reads one of them
+template <typename Fetch>
+void CPU::decode_block(Block &block, Fetch fetch) const
+{
+    static uint32_t align_table[] = { 0xFFFFFFFD, 0xFFFFFFFE };
+
+    uint32_t address = block.address;
+    bool end_of_block;
+
+    // Blocks never cross a 256-byte code page, so each WRAM block belongs to exactly one of them
+    do
+    {
+        Decoded_Instruction decoded {};
+
+        if (block.thumb)
+        {
+            decoded.instruction = fetch(address & align_table[1], true);
+            decoded.handler     = thumb_table[decoded.instruction >> 6u];
+            decoded.condition   = 0b1110;
+
+            end_of_block = is_block_end_thumb(decoded.instruction);
+
+            address += 2u;
+        }
+        else
+        {
+            decoded.instruction = fetch(address & align_table[0], false);
+            decoded.handler     = arm_table[((decoded.instruction >> 4u) & 0xFu) |
+                                            ((decoded.instruction >> 16u) & 0xFF0u)];
+            decoded.condition   = decoded.instruction >> 28u;
+
+            end_of_block = is_block_end_arm(decoded.instruction);
+
+            address += 4u;
+        }
+
+        block.instructions.push_back(decoded);
+    } while (!end_of_block && (address & CODE_PAGE_MASK) != 0);
+
+    if (block.thumb)
+    {
+        fuse_thumb_pairs(block);
+    }
+}
+
+// Common compiler idioms that run as one handler: BL, LDR rd, [pc, #imm] + BX rd, CMP + conditional branch,
+// and LSL + LSR/ASR on the same register for zero and sign extension
+CPU::Handler CPU::get_fused_handler(const uint16_t first, const uint16_t second) const
+{
+    if ((first & 0xF800u) == 0xF000u && (second & 0xF800u) == 0xF800u)
+    {
+        return &CPU::thumb_fused_long_branch;
+    }
+
+    if ((first & 0xF800u) == 0x4800u && (second & 0xFFC7u) == (0x4700u | ((first >> 5u) & 0x38u)))
+    {
+        return &CPU::thumb_fused_load_branch_exchange;
+    }
+
+    // Branch, not SWI or undefined
+    if ((second & 0xF000u) == 0xD000u && (second & 0xE00u) != 0xE00u)
+    {
+        if ((first & 0xF800u) == 0x2800u)
+        {
+            return &CPU::thumb_fused_compare_branch<true>;
+        }
+
+        if ((first & 0xFFC0u) == 0x4280u)
+        {
+            return &CPU::thumb_fused_compare_branch<false>;
+        }
+    }
+
+    // The second shift has to be by a non-zero amount, so it sets C on its own
+    if ((first & 0xF800u) == 0x0000u && (second & 0x07C0u) != 0 && (second & 0x3Fu) == ((first & 7u) * 9u))
+    {
+        if ((second & 0xF800u) == 0x0800u)
+        {
+            return &CPU::thumb_fused_extend<false>;
+        }
+
+        if ((second & 0xF800u) == 0x1000u)
+        {
+            return &CPU::thumb_fused_extend<true>;
+        }
+    }
+
+    return nullptr;
+}
+
+// The second instruction keeps its own entry, so a pair that gets split can continue from there
+void CPU::fuse_thumb_pairs(Block &block) const
+{
+    for (size_t i = 0; i + 1u < block.instructions.size(); i++)
+    {
+        Decoded_Instruction &first = block.instructions[i];
+        uint16_t second = block.instructions[i + 1u].instruction;
+        Handler handler = get_fused_handler(first.instruction, second);
+
+        if (handler != nullptr)
+        {
+            first.handler      = handler;
+            first.instruction |= (uint32_t)second << 16u;
+            first.fused        = true;
+
+            i++;
+        }
+    }
+}
+
+// Finishes the first instruction of a fused pair and fetches the second one. If an event or interrupt is due
+// in between, the pair is split like run_block would and the second instruction is left for the next block
+bool CPU::fetch_fused_instruction()
+{
+    scheduler->add_cycles(cycles);
+
+    cycles = 0;
+
+    if (scheduler->is_event_due() || is_interrupt_pending())
+    {
+        return false;
+    }
+
+    thumb_inst = thumb_inst_fused;
+    thumb_op   = thumb_inst >> 6u;
+
+    PROFILE_INSTRUCTION();
+
+    cycles += mmu->get_access_cycles(regs.pc, true, false);
+    regs.pc += 2u;
+
+    return true;
+}
+
+void CPU::compile_block(Block &block)
+{
+    decode_block(block, [this](const uint32_t address, const bool thumb) -> uint32_t
+    {
+        return (thumb) ? mmu->read16(address) : mmu->read32(address);
+    });
+
+    block.idle_loop = get_idle_loop(block);
+
+    //console->info("New {} block at {:08X}h, {} instructions", ((block.thumb) ? "Thumb" : "ARM"),
+    //              block.address, block.instructions.size());
+}
+
+// Walks the code reachable from the ROM entry point through direct branches, BL pairs and BX to literal addresses.
+// Runs on the predecode thread and only reads the ROM image, the blocks are merged by the CPU thread later
+void CPU::predecode_rom(const std::vector<uint8_t> &rom, const uint32_t rom_size)
+{
+    static constexpr size_t max_blocks = 0x10000;
+
+    std::vector<std::pair<uint32_t, bool>> pending = { { 0x08000000u, false } };
+
+    while (!pending.empty() && predecoded_blocks.size() < max_blocks)
+    {
+        auto [address, thumb] = pending.back();
+        uint32_t key = address | (uint32_t)thumb;
+
+        pending.pop_back();
+
+        if (predecoded_blocks.find(key) != predecoded_blocks.end())
+        {
+            continue;
+        }
+
+        Block block {};
+        bool out_of_bounds = false;
+
+        block.address = address;
+        block.thumb   = thumb;
+
+        decode_block(block, [&rom, &out_of_bounds](const uint32_t fetch_address, const bool fetch_thumb) -> uint32_t
+        {
+            uint32_t offset = fetch_address - 0x08000000u;
+
+            if (offset + ((fetch_thumb) ? 2u : 4u) > rom.size())
+            {
+                out_of_bounds = true;
+
+                return 0;
+            }
+
+            return (fetch_thumb) ? *(const uint16_t *)(rom.data() + offset) : *(const uint32_t *)(rom.data() + offset);
+        });
+
+        // The open bus past the end of the image is left to the CPU thread
+        if (out_of_bounds)
+        {
+            continue;
+        }
+
+        queue_successors(block, rom, rom_size, pending);
+
+        predecoded_blocks.emplace(key, std::move(block));
+    }
+
+    //console->info("Predecoded {} ROM blocks", predecoded_blocks.size());
+
+    predecode_done.store(true, std::memory_order_release);
+}
+
+void CPU::queue_successors(const Block &block, const std::vector<uint8_t> &rom, const uint32_t rom_size,
+                           std::vector<std::pair<uint32_t, bool>> &pending) const
+{
+    auto queue = [rom_size, &pending](const uint32_t target, const bool thumb)
+    {
+        if (target - 0x08000000u < rom_size)
+        {
+            pending.emplace_back(target & ((thumb) ? ~1u : ~3u), thumb);
+        }
+    };
+
+    auto read_literal = [&rom](const uint32_t address) -> uint32_t
+    {
+        uint32_t offset = address - 0x08000000u;
+
+        return (offset + 4u <= rom.size()) ? *(const uint32_t *)(rom.data() + offset) : 0;
+    };
+
+    size_t size  = block.instructions.size();
+    uint32_t width = (block.thumb) ? 2u : 4u;
+    uint32_t last_address = block.address + width * (uint32_t)(size - 1);
+    uint32_t next_address = block.address + width * (uint32_t)size;
+    uint32_t last = block.instructions.back().instruction;
+
+    if (block.thumb)
+    {
+        if (!is_block_end_thumb(last))
+        {
+            // Ended at a code page boundary
+            queue(next_address, true);
+
+            return;
+        }
+
+        if ((last & 0xF000u) == 0xD000u)
+        {
+            // SWI returns to the next instruction, conditional branches may fall through
+            if ((last & 0x0F00u) != 0x0E00u)
+            {
+                queue(next_address, true);
+            }
+
+            if ((last & 0x0E00u) != 0x0E00u)
+            {
+                queue(last_address + 4u + ((uint32_t)(int8_t)last << 1u), true);
+            }
+        }
+        else if ((last & 0xF800u) == 0xE000u)
+        {
+            queue(last_address + 4u + ((uint32_t)((int32_t)(last << 21u) >> 20)), true);
+        }
+        else if ((last & 0xF800u) == 0xF800u)
+        {
+            // The first half of BL holds the upper bits of the offset
+            uint32_t first = read_literal(last_address - 2u) & 0xFFFFu;
+
+            if (last_address >= 0x08000002u && (first & 0xF800u) == 0xF000u)
+            {
+                queue(last_address + 2u + ((uint32_t)((int32_t)(first << 21u) >> 9)) + ((last & 0x7FFu) << 1u), true);
+            }
+
+            queue(next_address, true);
+        }
+        else if ((last & 0xFF87u) == 0x4700u)
+        {
+            uint32_t rm = (last >> 3u) & 0xFu;
+
+            if (rm == 15)
+            {
+                queue((last_address + 4u) & ~3u, false);
+
+                return;
+            }
+
+            // Look for the LDR rm, [pc, #imm] that loaded the target
+            for (size_t i = size - 1; i-- > 0;)
+            {
+                uint32_t instruction = block.instructions[i].instruction;
+
+                if ((instruction & 0xF800u) == 0x4800u && ((instruction >> 8u) & 7u) == rm)
+                {
+                    uint32_t pc = (block.address + 2u * (uint32_t)i + 4u) & ~3u;
+                    uint32_t target = read_literal(pc + ((instruction & 0xFFu) << 2u));
+
+                    queue(target, (target & 1u) != 0);
+
+                    break;
+                }
+            }
+        }
+
+        return;
+    }
+
+    if (!is_block_end_arm(last))
+    {
+        queue(next_address, false);
+
+        return;
+    }
+
+    // A failed condition falls through to the next instruction
+    if ((last >> 28u) != 0b1110)
+    {
+        queue(next_address, false);
+    }
+
+    if ((last & 0x0E000000u) == 0x0A000000u)
+    {
+        queue(last_address + 8u + ((uint32_t)((int32_t)(last << 8u) >> 6)), false);
+
+        // BL returns to the next instruction
+        if ((last & 0x01000000u) != 0 && (last >> 28u) == 0b1110)
+        {
+            queue(next_address, false);
+        }
+    }
+    else if ((last & 0x0F000000u) == 0x0F000000u)
+    {
+        if ((last >> 28u) == 0b1110)
+        {
+            queue(next_address, false);
+        }
+    }
+    else if ((last & 0x0FFFFFF0u) == 0x012FFF10u)
+    {
+        uint32_t rm = last & 0xFu;
+
+        // Look for the LDR rm, [pc, #imm] or ADD rm, pc, #imm that set up the target
+        for (size_t i = size - 1; i-- > 0;)
+        {
+            uint32_t instruction = block.instructions[i].instruction;
+            uint32_t pc = block.address + 4u * (uint32_t)i + 8u;
+
+            if ((instruction & 0x0F7FF000u) == (0x051F0000u | (rm << 12u)))
+            {
+                uint32_t offset = instruction & 0xFFFu;
+                uint32_t target = read_literal(((instruction & 0x00800000u) != 0) ? pc + offset : pc - offset);
+
+                queue(target, (target & 1u) != 0);
+
+                break;
+            }
+            else if ((instruction & 0x0FFFF000u) == (0x028F0000u | (rm << 12u)))
+            {
+                uint32_t rotate = ((instruction >> 8u) & 0xFu) << 1u;
+                uint32_t imm    = instruction & 0xFFu;
+                uint32_t target = pc + ((rotate == 0) ? imm : (imm >> rotate) | (imm << (32u - rotate)));
+
+                queue(target, (target & 1u) != 0);
+
+                break;
+            }
+        }
+    }
+}
+
+void CPU::merge_predecoded_blocks()
+{
+    predecode_thread.join();
+
+    predecode_pending = false;
+
+    for (auto &[key, block] : predecoded_blocks)
+    {
+        // Idle loops may have been added after the thread started, so they're only looked up here
+        block.idle_loop = get_idle_loop(block);
+
+        block_cache.emplace(key, std::move(block));
+    }
+
+    predecoded_blocks.clear();
+}
+
+// Runs one decoded instruction without checking whether the block continues
+void CPU::execute_instruction(const Decoded_Instruction &decoded, const bool thumb)
+{
+    if (thumb)
+    {
+        thumb_inst = decoded.instruction;
+        thumb_op   = thumb_inst >> 6u;
+
+        thumb_inst_fused = decoded.instruction >> 16u;
+
+        cycles += mmu->get_access_cycles(regs.pc, true, false);
+        regs.pc += 2u;
+
+        (this->*decoded.handler)();
+    }
+    else
+    {
+        arm_inst = decoded.instruction;
+        arm_op   = ((arm_inst >> 4u) & 0xFu) | ((arm_inst >> 16u) & 0xFF0u);
+
+        cycles += mmu->get_access_cycles(regs.pc, true, true);
+        regs.pc += 4u;
+
+        if (decoded.condition == 0b1110 || is_condition(decoded.condition))
+        {
+            (this->*decoded.handler)();
+        }
+    }
+}
+
+// Returns whether the block goes on at next_address
+bool CPU::run_block_instruction(const Decoded_Instruction &decoded, const bool thumb, const uint32_t next_address)
+{
+    cycles = 0;
+
+    PROFILE_INSTRUCTION();
+
+    if (engine == CPU_ENGINE::Verified)
+    {
+        verify_instruction(decoded, thumb);
+    }
+
+    execute_instruction(decoded, thumb);
+
+    scheduler->add_cycles(cycles);
+
+    // The block may have been freed by a write to its own code page, don't touch it afterwards
+    if (block_invalidated)
+    {
+        return false;
+    }
+
+    return regs.pc == next_address && regs.cpsr.thumb_state == thumb && !scheduler->is_event_due() &&
+           !is_interrupt_pending() && power_state == POWER_STATE::Power_Running;
+}
+
+void CPU::run_block(Block &block)
+{
+    uint32_t address = block.address;
+    bool thumb  = block.thumb;
+    size_t size = block.instructions.size();
+
+    block_invalidated = false;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        const Decoded_Instruction &decoded = block.instructions[i];
+
+        // Both instructions of a fused pair run unless it's split, which ends the block
+        size_t next = i + ((decoded.fused) ? 2u : 1u);
+
+        if (!run_block_instruction(decoded, thumb, address + next * ((thumb) ? 2u : 4u)))
+        {
+            break;
+        }
+
+        i = next - 1u;
+    }
+}
+
+void CPU::run_native_block(Block &block)
+{
+    if (block.native == nullptr)
+    {
+        block.native = jit->compile(block);
+
+        if (block.native == nullptr)
+        {
+            // The code buffer is full, start over with the blocks that are run from now on
+            jit->flush();
+
+            for (auto &[key, cached_block] : block_cache)
+            {
+                cached_block.native = nullptr;
+            }
+
+            block.native = jit->compile(block);
+        }
+    }
+
+    block_invalidated = false;
+
+    block.native();
+
+    if (jit_exception)
+    {
+        std::exception_ptr exception = jit_exception;
+
+        jit_exception = nullptr;
+
+        std::rethrow_exception(exception);
+    }
+}
+
+bool CPU::jit_run_instruction(CPU *cpu, const Decoded_Instruction *decoded, const uint32_t next_address,
+                              const bool thumb)
+{
+    // Exceptions can't unwind through native code
+    try
+    {
+        return cpu->run_block_instruction(*decoded, thumb, next_address);
+    }
+    catch (...)
+    {
+        cpu->jit_exception = std::current_exception();
+
+        return false;
+    }
+}
+
+void CPU::jit_save_state(CPU *cpu)
+{
+    cpu->jit_snapshot = cpu->regs;
+    cpu->jit_snapshot_timestamp = cpu->scheduler->get_timestamp();
+}
+
+// Runs the instruction again with the interpreter, starting from the saved state, and compares the results
+bool CPU::jit_check_instruction(CPU *cpu, const Decoded_Instruction *decoded, const bool thumb)
+{
+    CPU_Registers native = cpu->regs;
+    uint64_t native_cycles = cpu->scheduler->get_timestamp() - cpu->jit_snapshot_timestamp;
+    uint32_t native_cpsr = cpu->get_cpsr();
+
+    cpu->regs = cpu->jit_snapshot;
+    cpu->cycles = 0;
+
+    cpu->execute_instruction(*decoded, thumb);
+
+    bool match = native.pc == cpu->regs.pc && native_cpsr == cpu->get_cpsr() && native_cycles == cpu->cycles;
+
+    for (int i = 0; i < 15; i++)
+    {
+        match = match && native.r[i] == cpu->regs.r[i];
+    }
+
+    if (!match)
+    {
+        cpu->console->critical("Native code for {:08X}h at {:08X}h doesn't match the interpreter!",
+                               decoded->instruction, cpu->jit_snapshot.pc);
+
+        cpu->jit_exception = std::make_exception_ptr(std::runtime_error("Native code doesn't match the interpreter!"));
+
+        return false;
+    }
+
+    return true;
+}
+
+// Instructions that can't write memory, switch modes or raise exceptions
+bool CPU::is_idle_instruction_arm(const uint32_t instruction) const
+{
+    bool load = ((instruction >> 20u) & 1u) != 0;
+
+    switch ((instruction >> 25u) & 7u)
+    {
+        case 0b000:
+            if ((instruction & 0x90u) == 0x90u)
+            {
+                // Multiplies are fine, swaps write memory, halfword transfers have to be loads
+                if ((instruction & 0x60u) == 0)
+                {
+                    return (instruction & 0x1000000u) == 0;
+                }
+
+                return load;
+            }
+            [[fallthrough]];
+        case 0b001:
+            // No MSR
+            return (instruction & 0x1B00000u) != 0x1200000u;
+        case 0b010:
+        case 0b011:
+            return load;
+        case 0b100:
+            // LDM without the S bit
+            return load && ((instruction >> 22u) & 1u) == 0;
+        default:
+            return false;
+    }
+}
+
+bool CPU::is_idle_instruction_thumb(const uint16_t instruction) const
+{
+    bool load = ((instruction >> 11u) & 1u) != 0;
+
+    switch (instruction >> 12u)
+    {
+        case 0x0:
+        case 0x1:
+        case 0x2:
+        case 0x3:
+        case 0xA:
+            return true;
+        case 0x4:
+            // Everything but BX
+            return (instruction & 0xFF00u) != 0x4700u;
+        case 0x5:
+            // STRH is the only store among the sign-extended forms
+            return ((instruction >> 9u) & 1u) == 0 ? load : (instruction & 0xC00u) != 0;
+        case 0x6:
+        case 0x7:
+        case 0x8:
+        case 0x9:
+        case 0xC:
+            return load;
+        default:
+            return false;
+    }
+}
+
+IDLE_LOOP CPU::get_idle_loop(const Block &block) const
+{
+    // Idle loops are a handful of loads and compares
+    constexpr size_t max_length = 8;
+
+    if (known_idle_loops.count(block.address) != 0)
+    {
+        return IDLE_LOOP::Idle_Known;
+    }
+
+    size_t size = block.instructions.size();
+
+    if (size > max_length)
+    {
+        return IDLE_LOOP::Not_Idle;
+    }
+
+    uint32_t last = block.instructions.back().instruction;
+    uint32_t target;
+
+    if (block.thumb)
+    {
+        uint32_t pc = block.address + (uint32_t)(size - 1u) * 2u + 4u;
+
+        if ((last & 0xF000u) == 0xD000u && (last & 0xF00u) != 0xF00u)
+        {
+            target = pc + (int32_t)(int8_t)(last & 0xFFu) * 2;
+        }
+        else if ((last & 0xF800u) == 0xE000u)
+        {
+            target = pc + (((last & 0x7FFu) << 1u) ^ 0x800u) - 0x800u;
+        }
+        else
+        {
+            return IDLE_LOOP::Not_Idle;
+        }
+    }
+    else
+    {
+        uint32_t pc = block.address + (uint32_t)(size - 1u) * 4u + 8u;
+
+        // B, not BL
+        if ((last & 0xF000000u) != 0xA000000u)
+        {
+            return IDLE_LOOP::Not_Idle;
+        }
+
+        target = pc + ((((last & 0xFFFFFFu) << 2u) ^ 0x2000000u) - 0x2000000u);
+    }
+
+    if (target != block.address)
+    {
+        return IDLE_LOOP::Not_Idle;
+    }
+
+    for (size_t i = 0; i < size - 1u; i++)
+    {
+        uint32_t instruction = block.instructions[i].instruction;
+
+        if ((block.thumb) ? !is_idle_instruction_thumb(instruction) : !is_idle_instruction_arm(instruction))
+        {
+            return IDLE_LOOP::Not_Idle;
+        }
+    }
+
+    return IDLE_LOOP::Idle_Candidate;
+}
+
+// Runs a possible idle loop once. If the loop is known to be idle, or the iteration didn't change any register,
+// flag or read a timer, nothing can happen until the next event fires, so the scheduler skips straight to it
+void CPU::run_idle_loop(Block &block)
+{
+    uint32_t address = block.address;
+    bool thumb = block.thumb;
+    bool known = block.idle_loop == IDLE_LOOP::Idle_Known;
+    std::array<uint32_t, 15> registers {};
+    uint32_t nzcv = get_nzcv();
+
+    std::copy_n(regs.r, 15, registers.begin());
+
+    mmu->timer_read = false;
+
+    if (engine == CPU_ENGINE::Native || engine == CPU_ENGINE::Native_Checked)
+    {
+        run_native_block(block);
+    }
+    else
     {
-        value += 4u;
+        run_block(block);
     }
 
-    switch (mode)
+    // The block may have been freed, only use the copies from here on
+    if (block_invalidated || regs.pc != address || regs.cpsr.thumb_state != thumb || is_interrupt_pending())
     {
-        case 0b00:
-            return logical_shift_left(value, amount, set_c, immediate);
-        case 0b01:
-            return logical_shift_right(value, amount, set_c, immediate);
-        case 0b10:
-            return arithmetic_shift_right(value, amount, set_c, immediate);
-        case 0b11:
-            return rotate_right(value, amount, set_c, immediate);
-        default:
-            return 0xC0FFEE;
+        return;
+    }
+
+    if (!known)
+    {
+        // Loops that keep changing the state are computing something, they stop being checked after a few tries
+        constexpr uint8_t max_misses = 4;
+
+        if (mmu->timer_read || get_nzcv() != nzcv || !std::equal(registers.begin(), registers.end(), regs.r))
+        {
+            if (++block.idle_misses == max_misses)
+            {
+                block.idle_loop = IDLE_LOOP::Not_Idle;
+            }
+
+            return;
+        }
+
+        block.idle_misses = 0;
+    }
+
+    if (scheduler->get_timestamp() < scheduler->get_next_event())
+    {
+        scheduler->add_cycles(scheduler->get_next_event() - scheduler->get_timestamp());
+    }
+}
+
+void CPU::verify_instruction(const Decoded_Instruction &decoded, const bool thumb) const
+{
+    uint32_t instruction = (thumb) ? mmu->read16(get_pc()) : mmu->read32(get_pc());
+
+    if (decoded.fused)
+    {
+        instruction |= (uint32_t)mmu->read16(get_pc() + 2u) << 16u;
+    }
+
+    if (instruction != decoded.instruction)
+    {
+        console->critical("Stale block cache entry at {:08X}h! Cached: {:08X}h, memory: {:08X}h",
+                          get_pc(), decoded.instruction, instruction);
+
+        throw std::runtime_error("Stale block cache entry!");
+    }
+}
+
+void CPU::invalidate_blocks(const uint32_t page)
+{
+    auto blocks = code_pages.find(page);
+
+    if (blocks == code_pages.end())
+    {
+        return;
+    }
+
+    for (uint32_t key : blocks->second)
+    {
+        block_cache.erase(key);
+    }
+
+    code_pages.erase(blocks);
+
+    block_invalidated = true;
+}
+
+template <bool immediate, bool set_c, uint32_t mode>
+uint32_t CPU::barrel_shifter(const uint16_t operand, const bool dp)
+{
+    uint8_t rm     = operand & 0xFu;
+    uint32_t value = get_register(rm);
+    uint8_t amount = ((immediate) ? (operand >> 7u) : get_register(operand >> 8u));
+
+    if constexpr (!immediate)
+    {
+        if (dp && rm == 15)
+        {
+            value += 4u;
+        }
+
+        ++cycles;
+    }
+
+    if constexpr (mode == 0b00)
+    {
+        return logical_shift_left(value, amount, set_c, immediate);
+    }
+    else if constexpr (mode == 0b01)
+    {
+        return logical_shift_right(value, amount, set_c, immediate);
+    }
+    else if constexpr (mode == 0b10)
+    {
+        return arithmetic_shift_right(value, amount, set_c, immediate);
+    }
+    else
+    {
+        return rotate_right(value, amount, set_c, immediate);
     }
 }
 
@@ -793,7 +1933,7 @@ uint32_t CPU::lsl(const uint32_t value, const uint8_t amount)
 
 uint32_t CPU::lsl_set(const uint32_t value, const uint8_t amount)
 {
-    regs.cpsr.carry = (value & (1u << (32u - amount))) != 0;
+    set_carry((value & (1u << (32u - amount))) != 0);
 
     return lsl(value, amount);
 }
@@ -834,7 +1974,7 @@ uint32_t CPU::lsl_set_reg(const uint32_t value, const uint8_t amount)
         return lsl_set(value, amount);
     }
 
-    regs.cpsr.carry = amount == 32 && (value & 1u) != 0;
+    set_carry(amount == 32 && (value & 1u) != 0);
 
     return 0;
 }
@@ -846,7 +1986,7 @@ uint32_t CPU::lsr(const uint32_t value, const uint8_t amount)
 
 uint32_t CPU::lsr_set(const uint32_t value, const uint8_t amount)
 {
-    regs.cpsr.carry = (value & (1u << (amount - 1u))) != 0;
+    set_carry((value & (1u << (amount - 1u))) != 0);
 
     return lsr(value, amount);
 }
@@ -875,7 +2015,7 @@ uint32_t CPU::lsr_set_imm(const uint32_t value, const uint8_t amount)
 {
     if (amount == 0)
     {
-        regs.cpsr.carry = ((value >> 31u) & 1u) != 0;
+        set_carry(((value >> 31u) & 1u) != 0);
 
         return 0;
     }
@@ -894,7 +2034,7 @@ uint32_t CPU::lsr_set_reg(const uint32_t value, const uint8_t amount)
         return lsr_set(value, amount);
     }
 
-    regs.cpsr.carry = amount == 32 && ((value >> 31u) & 1u) != 0;
+    set_carry(amount == 32 && ((value >> 31u) & 1u) != 0);
 
     return 0;
 }
@@ -906,7 +2046,7 @@ uint32_t CPU::asr(const uint32_t value, const uint8_t amount)
 
 uint32_t CPU::asr_set(const uint32_t value, const uint8_t amount)
 {
-    regs.cpsr.carry = (value & (1u << (amount - 1u))) != 0;
+    set_carry((value & (1u << (amount - 1u))) != 0);
 
     return asr(value, amount);
 }
@@ -935,7 +2075,7 @@ uint32_t CPU::asr_set_imm(const uint32_t value, const uint8_t amount)
 {
     if (amount == 0)
     {
-        regs.cpsr.carry = ((value >> 31u) & 1u) != 0;
+        set_carry(((value >> 31u) & 1u) != 0);
 
         return asr(value, 31);
     }
@@ -954,7 +2094,7 @@ uint32_t CPU::asr_set_reg(const uint32_t value, const uint8_t amount)
         return asr_set(value, amount);
     }
 
-    regs.cpsr.carry = ((value >> 31u) & 1u) != 0;
+    set_carry(((value >> 31u) & 1u) != 0);
 
     return asr(value, 31);
 }
@@ -966,7 +2106,7 @@ uint32_t CPU::ror(const uint32_t value, const uint8_t amount)
 
 uint32_t CPU::ror_set(const uint32_t value, const uint8_t amount)
 {
-    regs.cpsr.carry = (value & (1u << (amount - 1u))) != 0;
+    set_carry((value & (1u << (amount - 1u))) != 0);
 
     return ror(value, amount);
 }
@@ -1003,21 +2143,21 @@ uint32_t CPU::ror_set_reg(const uint32_t value, const uint8_t amount)
         return value;
     }
 
-    regs.cpsr.carry = (value & (1u << ((amount - 1u) & 0x1Fu))) != 0;
+    set_carry((value & (1u << ((amount - 1u) & 0x1Fu))) != 0);
 
     return ror(value, amount & 0x1Fu);
 }
 
 uint32_t CPU::rrx(const uint32_t value)
 {
-    return (value >> 1u) | ((uint32_t)(regs.cpsr.carry) << 31u);
+    return (value >> 1u) | ((uint32_t)get_carry() << 31u);
 }
 
 uint32_t CPU::rrx_set(const uint32_t value)
 {
     uint32_t result = rrx(value);
 
-    regs.cpsr.carry = (value & 1u) != 0;
+    set_carry((value & 1u) != 0);
 
     return result;
 }
@@ -1026,12 +2166,16 @@ void CPU::undefined_instruction()
 {
     console->critical("Undefined instruction!");
     console->error("ARM instruction: {:08X}h, ARM opcode: {:03X}h", arm_inst, arm_op);
-    console->error("Thumb instruction: {:04X}h, Thumb opcode: {:02X}h", thumb_inst, thumb_op);
+    console->error("Thumb instruction: {:04X}h, Thumb opcode: {:03X}h", thumb_inst, thumb_op);
 
-    regs.lr_banked[get_index(CPU_MODE::Undefined)] = get_pc();
-    regs.spsr_banked[get_index(CPU_MODE::Undefined) - 1u] = regs.cpsr;
-    set_cpsr((regs.cpsr.cpsr & 0xFFFFFF00u) | 0b10011011u, true);
+    uint32_t return_address = get_pc();
+    uint32_t old_cpsr = get_cpsr();
+
+    set_cpsr((old_cpsr & 0xFFFFFF00u) | 0b10011011u, true);
+    set_spsr(old_cpsr);
+    regs.r[14] = return_address;
     regs.pc = 4;
+    refill_pipeline();
 
     //dump_registers();
 
@@ -1042,10 +2186,14 @@ void CPU::hardware_interrupt()
 {
     console->info("Hardware interrupt");
 
-    regs.lr_banked[get_index(CPU_MODE::IRQ)] = get_pc();
-    regs.spsr_banked[get_index(CPU_MODE::IRQ) - 1u] = regs.cpsr;
-    set_cpsr((regs.cpsr.cpsr & 0xFFFFFF00u) | 0b10010010u, true);
+    uint32_t return_address = get_pc() + 4u;
+    uint32_t old_cpsr = get_cpsr();
+
+    set_cpsr((old_cpsr & 0xFFFFFF00u) | 0b10010010u, true);
+    set_spsr(old_cpsr);
+    regs.r[14] = return_address;
     regs.pc = 0x18;
+    refill_pipeline();
 }
 
 void CPU::software_interrupt()
@@ -1053,42 +2201,366 @@ void CPU::software_interrupt()
     console->info("Software interrupt SWI ${:0X}",
             ((regs.cpsr.thumb_state) ? thumb_inst & 0xFFu : arm_inst & 0xFFFFFFu));
 
-    regs.lr_banked[get_index(CPU_MODE::Supervisor)] = get_pc();
-    regs.spsr_banked[get_index(CPU_MODE::Supervisor) - 1u].cpsr = get_cpsr();
-    set_cpsr((regs.cpsr.cpsr & 0xFFFFFF00u) | 0b11010011u, true);
+    if (hle_swi && hle_software_interrupt((regs.cpsr.thumb_state) ? thumb_inst & 0xFFu : (arm_inst >> 16u) & 0xFFu))
+    {
+        return;
+    }
+
+    uint32_t return_address = get_pc();
+    uint32_t old_cpsr = get_cpsr();
+
+    set_cpsr((old_cpsr & 0xFFFFFF00u) | 0b11010011u, true);
+    set_spsr(old_cpsr);
+    regs.r[14] = return_address;
     regs.pc = 8;
+    refill_pipeline();
 }
 
-void CPU::arm_block_data_transfer()
+// BIOS functions implemented natively, everything else still runs in the BIOS. Cycle counts are approximations
+// of the BIOS routines including the SWI entry and return
+bool CPU::hle_software_interrupt(const uint8_t number)
 {
-    bool pre_index = ((arm_inst >> 24u) & 1u) != 0;
-    bool up    = ((arm_inst >> 23u) & 1u) != 0;
-    bool user  = ((arm_inst >> 22u) & 1u) != 0;
-    bool write_back = ((arm_inst >> 21u) & 1u) != 0;
-    bool load  = ((arm_inst >> 20u) & 1u) != 0;
-    uint8_t rn = (arm_inst >> 16u) & 0xFu;
-    uint16_t rlist = arm_inst & 0xFFFFu;
+    constexpr uint32_t swi_cycles = 20;
 
-    switch ((uint8_t)up << 1u | (uint8_t)load)
+    cycles += swi_cycles;
+
+    switch (number)
     {
-        case 0b00:
-            stmd(rn, rlist, !pre_index, user, write_back);
+        case 0x02:
+            halt(false);
             break;
-        case 0b01:
-            ldmd(rn, rlist, !pre_index, user, write_back);
+        case 0x03:
+            halt(true);
             break;
-        case 0b10:
-            stmi(rn, rlist, pre_index, user, write_back);
+        case 0x04:
+            hle_intr_wait(get_register(0) != 0, get_register(1));
             break;
-        case 0b11:
-            ldmi(rn, rlist, pre_index, user, write_back);
+        case 0x05:
+            set_register(0, 1);
+            set_register(1, 1);
+
+            hle_intr_wait(true, 1);
+            break;
+        case 0x06:
+            hle_div(get_register(0), get_register(1));
+            break;
+        case 0x07:
+            hle_div(get_register(1), get_register(0));
+            break;
+        case 0x08:
+            hle_sqrt();
+            break;
+        case 0x09:
+            hle_arctan();
+            break;
+        case 0x0A:
+            hle_arctan2();
+            break;
+        case 0x0B:
+            hle_cpu_set();
+            break;
+        case 0x0C:
+            hle_cpu_fast_set();
+            break;
+        case 0x0E:
+            hle_bg_affine_set();
+            break;
+        case 0x0F:
+            hle_obj_affine_set();
+            break;
+        case 0x10:
+            hle_write_output(get_register(1), bios_bit_unpack(*mmu, get_register(0), get_register(2)), 4);
             break;
+        case 0x11:
+        case 0x12:
+            hle_write_output(get_register(1), bios_lz77_uncomp(*mmu, get_register(0)), (number == 0x12) ? 2u : 1u);
+            break;
+        case 0x13:
+            hle_write_output(get_register(1), bios_huff_uncomp(*mmu, get_register(0)), 4);
+            break;
+        case 0x14:
+        case 0x15:
+            hle_write_output(get_register(1), bios_rl_uncomp(*mmu, get_register(0)), (number == 0x15) ? 2u : 1u);
+            break;
+        case 0x16:
+        case 0x17:
+            hle_write_output(get_register(1), bios_diff_unfilter(*mmu, get_register(0), false),
+                             (number == 0x17) ? 2u : 1u);
+            break;
+        case 0x18:
+            hle_write_output(get_register(1), bios_diff_unfilter(*mmu, get_register(0), true), 2);
+            break;
+        default:
+            cycles -= swi_cycles;
+
+            return false;
+    }
+
+    return true;
+}
+
+// Waits for one of the flags in BIOS_IF (0x3007FF8), which user IRQ handlers set.
+// Until then the SWI halts and runs again after each interrupt
+void CPU::hle_intr_wait(const bool discard, const uint16_t flags)
+{
+    uint16_t bios_flags = mmu->read16(0x3007FF8);
+
+    if (discard && !intr_wait_pending)
+    {
+        bios_flags &= (uint16_t)~flags;
+    }
+
+    interrupts->set_master_enable(1);
+
+    if ((bios_flags & flags) != 0)
+    {
+        mmu->write16(bios_flags & (uint16_t)~flags, 0x3007FF8);
+
+        intr_wait_pending = false;
+        return;
+    }
+
+    mmu->write16(bios_flags, 0x3007FF8);
+
+    intr_wait_pending = true;
+    regs.pc -= (regs.cpsr.thumb_state) ? 2u : 4u;
+
+    halt(false);
+}
+
+void CPU::hle_div(const int32_t numerator, const int32_t denominator)
+{
+    cycles += 60;
+
+    if (denominator == 0)
+    {
+        // The BIOS never returns for most numerators here
+        console->warn("Division by zero!");
+
+        set_register(0, (numerator < 0) ? 0xFFFFFFFFu : 1u);
+        set_register(1, numerator);
+        set_register(3, 1);
+    }
+    else if (denominator == -1 && numerator == INT32_MIN)
+    {
+        set_register(0, 0x80000000u);
+        set_register(1, 0);
+        set_register(3, 0x80000000u);
+    }
+    else
+    {
+        int32_t quotient = numerator / denominator;
+
+        set_register(0, quotient);
+        set_register(1, numerator % denominator);
+        set_register(3, (quotient < 0) ? -(uint32_t)quotient : quotient);
+    }
+}
+
+void CPU::hle_sqrt()
+{
+    uint32_t value  = get_register(0);
+    uint32_t result = 0;
+
+    cycles += 80;
+
+    for (uint32_t bit = 1u << 15u; bit != 0; bit >>= 1u)
+    {
+        uint32_t candidate = result | bit;
+
+        if (candidate * candidate <= value)
+        {
+            result = candidate;
+        }
+    }
+
+    set_register(0, result);
+}
+
+void CPU::hle_arctan()
+{
+    int32_t a;
+    int32_t b;
+
+    cycles += 50;
+
+    set_register(0, bios_arctan(get_register(0), a, b));
+    set_register(1, a);
+    set_register(3, b);
+}
+
+void CPU::hle_arctan2()
+{
+    int32_t a = 0;
+    int32_t b = 0;
+
+    cycles += 120;
+
+    set_register(0, (uint16_t)bios_arctan2(get_register(0), get_register(1), a, b));
+    set_register(1, a);
+    set_register(3, b);
+}
+
+// r0 source, r1 destination, r2 bits 0-20 count, bit 24 fill, bit 26 words
+void CPU::hle_cpu_set()
+{
+    uint32_t control = get_register(2);
+    uint32_t count = control & 0x1FFFFFu;
+    bool fill = ((control >> 24u) & 1u) != 0;
+    bool word = ((control >> 26u) & 1u) != 0;
+    uint32_t align  = (word) ? 0xFFFFFFFCu : 0xFFFFFFFEu;
+    uint32_t source = get_register(0) & align;
+    uint32_t destination = get_register(1) & align;
+
+    // The BIOS refuses to copy from itself
+    if ((source & 0xE000000u) == 0)
+    {
+        return;
+    }
+
+    cycles += count * (mmu->get_access_cycles(destination, true, word) + ((fill) ? 3u :
+                       mmu->get_access_cycles(source, true, word) + 4u));
+
+    if (fill)
+    {
+        mmu->fill_block(destination, (word) ? mmu->read32(source) : mmu->read16(source), count, word);
+    }
+    else
+    {
+        mmu->copy_block(destination, source, count, word);
+    }
+}
+
+// Like CpuSet, but always copies words and rounds the count up to a multiple of 8
+void CPU::hle_cpu_fast_set()
+{
+    uint32_t control = get_register(2);
+    uint32_t count = ((control & 0x1FFFFFu) + 7u) & ~7u;
+    bool fill = ((control >> 24u) & 1u) != 0;
+    uint32_t source = get_register(0) & 0xFFFFFFFCu;
+    uint32_t destination = get_register(1) & 0xFFFFFFFCu;
+
+    if ((source & 0xE000000u) == 0)
+    {
+        return;
+    }
+
+    cycles += count * (mmu->get_access_cycles(destination, true, true) + ((fill) ? 0u :
+                       mmu->get_access_cycles(source, true, true))) + (count / 8u) * 4u;
+
+    if (fill)
+    {
+        mmu->fill_block(destination, mmu->read32(source), count, true);
+    }
+    else
+    {
+        mmu->copy_block(destination, source, count, true);
+    }
+}
+
+// r0 points to 20 byte entries (s32 center x/y in 19.8, s16 screen center x/y, s16 scale x/y in 8.8, u16 angle),
+// r1 to 16 byte entries (s16 PA-PD, s32 reference point x/y), r2 is the number of entries
+void CPU::hle_bg_affine_set()
+{
+    uint32_t source = get_register(0);
+    uint32_t destination = get_register(1);
+    uint32_t count = get_register(2);
+
+    cycles += count * 60u;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto center_x = (int32_t)mmu->read32(source);
+        auto center_y = (int32_t)mmu->read32(source + 4u);
+        auto screen_x = (int16_t)mmu->read16(source + 8u);
+        auto screen_y = (int16_t)mmu->read16(source + 10u);
+        auto scale_x  = (int16_t)mmu->read16(source + 12u);
+        auto scale_y  = (int16_t)mmu->read16(source + 14u);
+        uint8_t angle = mmu->read16(source + 16u) >> 8u;
+        int32_t sin = sine_table[angle];
+        int32_t cos = sine_table[(uint8_t)(angle + 0x40u)];
+        int32_t pa  = multiply_wrap(scale_x, cos) >> 14;
+        int32_t pb  = -(multiply_wrap(scale_x, sin) >> 14);
+        int32_t pc  = multiply_wrap(scale_y, sin) >> 14;
+        int32_t pd  = multiply_wrap(scale_y, cos) >> 14;
+
+        mmu->write16(pa, destination);
+        mmu->write16(pb, destination + 2u);
+        mmu->write16(pc, destination + 4u);
+        mmu->write16(pd, destination + 6u);
+        mmu->write32(center_x - (multiply_wrap(pa, screen_x) + multiply_wrap(pb, screen_y)), destination + 8u);
+        mmu->write32(center_y - (multiply_wrap(pc, screen_x) + multiply_wrap(pd, screen_y)), destination + 12u);
+
+        source += 20u;
+        destination += 16u;
+    }
+}
+
+// r0 points to 8 byte entries (s16 scale x/y in 8.8, u16 angle), r1 to PA, r2 is the number of entries
+// and r3 the distance between PA, PB, PC and PD (2 for consecutive halfwords, 8 for OAM)
+void CPU::hle_obj_affine_set()
+{
+    uint32_t source = get_register(0);
+    uint32_t destination = get_register(1);
+    uint32_t count  = get_register(2);
+    uint32_t stride = get_register(3);
+
+    cycles += count * 40u;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto scale_x  = (int16_t)mmu->read16(source);
+        auto scale_y  = (int16_t)mmu->read16(source + 2u);
+        uint8_t angle = mmu->read16(source + 4u) >> 8u;
+        int32_t sin = sine_table[angle];
+        int32_t cos = sine_table[(uint8_t)(angle + 0x40u)];
+
+        mmu->write16(multiply_wrap(scale_x, cos) >> 14, destination);
+        mmu->write16(-(multiply_wrap(scale_x, sin) >> 14), destination + stride);
+        mmu->write16(multiply_wrap(scale_y, sin) >> 14, destination + stride * 2u);
+        mmu->write16(multiply_wrap(scale_y, cos) >> 14, destination + stride * 3u);
+
+        source += 8u;
+        destination += stride * 4u;
+    }
+}
+
+void CPU::hle_write_output(const uint32_t destination, std::vector<uint8_t> output, const uint32_t unit)
+{
+    bios_write_output(*mmu, destination, output, unit);
+
+    // Rough estimate of the BIOS decoding loops, a few instructions per byte plus the stores
+    cycles += (uint32_t)output.size() * 6u +
+              (uint32_t)(output.size() / unit) * mmu->get_access_cycles(destination, true, unit == 4u);
+}
+
+template <bool pre_index, bool up, bool user, bool write_back, bool load>
+void CPU::arm_block_data_transfer()
+{
+    uint8_t rn = (arm_inst >> 16u) & 0xFu;
+    uint16_t rlist = arm_inst & 0xFFFFu;
+
+    if constexpr (!up && !load)
+    {
+        stmd(rn, rlist, !pre_index, user, write_back);
+    }
+    else if constexpr (!up && load)
+    {
+        ldmd(rn, rlist, !pre_index, user, write_back);
+    }
+    else if constexpr (up && !load)
+    {
+        stmi(rn, rlist, pre_index, user, write_back);
+    }
+    else
+    {
+        ldmi(rn, rlist, pre_index, user, write_back);
     }
 }
 
+template <bool link>
 void CPU::arm_branch()
 {
-    bool link = ((arm_inst >> 24u) & 1u) != 0;
     uint32_t offset = (arm_inst & 0xFFFFFFu) << 2u;
 
     if ((offset & 0x3000000u) != 0)
@@ -1096,7 +2568,7 @@ void CPU::arm_branch()
         offset |= 0xFC000000u;
     }
 
-    if (link)
+    if constexpr (link)
     {
         set_register(14, get_pc());
     }
@@ -1117,176 +2589,185 @@ void CPU::arm_branch_and_exchange()
     //console->info("bx r{}", rs);
 }
 
+template <bool imm_op, uint32_t op, bool set_c, uint32_t shift>
 void CPU::arm_data_processing()
 {
-    bool imm_op   = ((arm_inst >> 25u) & 1u) != 0;
-    uint8_t op    = (arm_inst >> 21u) & 0xFu;
-    bool set_c    = ((arm_inst >> 20u) & 1u) != 0;
     uint8_t rn    = (arm_inst >> 16u) & 0xFu;
     uint8_t rd    = (arm_inst >> 12u) & 0xFu;
     uint32_t op_1 = get_register(rn);
     uint32_t op_2;
 
-    if (imm_op)
+    if constexpr (imm_op)
+    {
+        op_2 = rotate_immediate(arm_inst & 0xFFFu);
+    }
+    else
+    {
+        op_2 = barrel_shifter<(shift & 1u) == 0, set_c, (shift >> 1u) & 3u>(arm_inst & 0xFFFu, true);
+    }
+
+    if constexpr (op == 0b0000)
+    {
+        logical_and(op_1, op_2, rd, set_c);
+    }
+    else if constexpr (op == 0b0001)
+    {
+        logical_eor(op_1, op_2, rd, set_c);
+    }
+    else if constexpr (op == 0b0010)
+    {
+        sub(op_1, op_2, rd, set_c);
+    }
+    else if constexpr (op == 0b0011)
+    {
+        sub(op_2, op_1, rd, set_c);
+    }
+    else if constexpr (op == 0b0100)
+    {
+        add(op_1, op_2, rd, set_c);
+    }
+    else if constexpr (op == 0b0101)
+    {
+        adc(op_1, op_2, rd, set_c);
+    }
+    else if constexpr (op == 0b0110)
+    {
+        sbc(op_1, op_2, rd, set_c);
+    }
+    else if constexpr (op == 0b0111)
+    {
+        sbc(op_2, op_1, rd, set_c);
+    }
+    else if constexpr (op == 0b1000)
+    {
+        if constexpr (set_c)
+        {
+            tst(op_1, op_2);
+        }
+        else
+        {
+            mrs();
+        }
+    }
+    else if constexpr (op == 0b1001)
+    {
+        if constexpr (set_c)
+        {
+            teq(op_1, op_2);
+        }
+        else
+        {
+            msr();
+        }
+    }
+    else if constexpr (op == 0b1010)
+    {
+        if constexpr (set_c)
+        {
+            cmp(op_1, op_2);
+        }
+        else
+        {
+            mrs();
+        }
+    }
+    else if constexpr (op == 0b1011)
     {
-        op_2 = rotate_immediate(arm_inst & 0xFFFu);
+        if constexpr (set_c)
+        {
+            cmn(op_1, op_2);
+        }
+        else
+        {
+            msr();
+        }
     }
-    else
+    else if constexpr (op == 0b1100)
     {
-        op_2 = barrel_shifter((arm_inst & 0x10u) == 0, set_c, arm_inst & 0xFFFu, true);
+        logical_or(op_1, op_2, rd, set_c);
     }
-
-    switch (op)
+    else if constexpr (op == 0b1101)
     {
-        case 0b0000:
-            logical_and(op_1, op_2, rd, set_c);
-            break;
-        case 0b0001:
-            logical_eor(op_1, op_2, rd, set_c);
-            break;
-        case 0b0010:
-            sub(op_1, op_2, rd, set_c);
-            break;
-        case 0b0011:
-            sub(op_2, op_1, rd, set_c);
-            break;
-        case 0b0100:
-            add(op_1, op_2, rd, set_c);
-            break;
-        case 0b0101:
-            adc(op_1, op_2, rd, set_c);
-            break;
-        case 0b0110:
-            sbc(op_1, op_2, rd, set_c);
-            break;
-        case 0b0111:
-            sbc(op_2, op_1, rd, set_c);
-            break;
-        case 0b1000:
-            if (set_c)
-            {
-                tst(op_1, op_2);
-            }
-            else
-            {
-                mrs();
-            }
-            break;
-        case 0b1001:
-            if (set_c)
-            {
-                teq(op_1, op_2);
-            }
-            else
-            {
-                msr();
-            }
-            break;
-        case 0b1010:
-            if (set_c)
-            {
-                cmp(op_1, op_2);
-            }
-            else
-            {
-                mrs();
-            }
-            break;
-        case 0b1011:
-            if (set_c)
-            {
-                cmn(op_1, op_2);
-            }
-            else
-            {
-                msr();
-            }
-            break;
-        case 0b1100:
-            logical_or(op_1, op_2, rd, set_c);
-            break;
-        case 0b1101:
-            mov(op_2, rd, set_c);
-            break;
-        case 0b1110:
-            bic(op_1, op_2, rd, set_c);
-            break;
-        case 0b1111:
-            mov(~op_2, rd, set_c);
-            break;
-        default:
-            break;
+        mov(op_2, rd, set_c);
+    }
+    else if constexpr (op == 0b1110)
+    {
+        bic(op_1, op_2, rd, set_c);
+    }
+    else if constexpr (op == 0b1111)
+    {
+        mov(~op_2, rd, set_c);
     }
 
-    if (set_c && rd == 15)
+    if constexpr (set_c)
     {
-        console->critical("ALU mode change");
+        if (rd == 15)
+        {
+            console->critical("ALU mode change");
 
-        set_cpsr(get_spsr(), true);
+            set_cpsr(get_spsr(), true);
+        }
     }
 }
 
+template <bool pre_index, bool up, bool imm, bool write_back, bool load, uint32_t is_signed_halfword>
 void CPU::arm_halfword_data_transfer()
 {
-    bool pre_index = ((arm_inst >> 24u) & 1u) != 0;
-    bool up   = ((arm_inst >> 23u) & 1u) != 0;
-    bool imm  = ((arm_inst >> 22u) & 1u) != 0;
-    bool write_back = ((arm_inst >> 21u) & 1u) != 0;
-    bool load = ((arm_inst >> 20u) & 1u) != 0;
     uint8_t rn = (arm_inst >> 16u) & 0xFu;
     uint8_t rd = (arm_inst >> 12u) & 0xFu;
     uint32_t offset = ((imm) ? ((arm_inst >> 4u) & 0xF0u) | (arm_inst & 0xFu) : get_register(arm_inst & 0xFu));
-    uint8_t is_signed_halfword = (arm_inst >> 5u) & 3u;
     uint32_t base = get_register(rn);
 
-    if (pre_index)
+    if constexpr (pre_index)
     {
         (up) ? base += offset : base -= offset;
     }
 
-    switch (is_signed_halfword)
+    cycles += mmu->get_access_cycles(base, false, false) + ((load) ? 1u : 0);
+
+    if constexpr (is_signed_halfword == 0b00)
     {
-        case 0b00:
-            console->error("Single data swap!");
+        console->error("Single data swap!");
 
-            throw std::runtime_error("Single data swap!");
-        case 0b01:
-            if (load)
-            {
-                set_register(rd, mmu->read16(base));
-            }
-            else
-            {
-                mmu->write16(get_register(rd), base);
-            }
-            break;
-        case 0b10:
-            if (load)
-            {
-                set_register(rd, (int32_t)(int8_t)mmu->read8(base));
-            }
-            else
-            {
-                undefined_instruction();
-            }
-            break;
-        case 0b11:
-            if (load)
-            {
-                set_register(rd, (int32_t)(int16_t)mmu->read16(base));
-            }
-            else
-            {
-                undefined_instruction();
-            }
-            break;
-        default:
-            break;
+        throw std::runtime_error("Single data swap!");
+    }
+    else if constexpr (is_signed_halfword == 0b01)
+    {
+        if constexpr (load)
+        {
+            set_register(rd, mmu->read16(base));
+        }
+        else
+        {
+            mmu->write16(get_register(rd), base);
+        }
+    }
+    else if constexpr (is_signed_halfword == 0b10)
+    {
+        if constexpr (load)
+        {
+            set_register(rd, (int32_t)(int8_t)mmu->read8(base));
+        }
+        else
+        {
+            undefined_instruction();
+        }
+    }
+    else
+    {
+        if constexpr (load)
+        {
+            set_register(rd, (int32_t)(int16_t)mmu->read16(base));
+        }
+        else
+        {
+            undefined_instruction();
+        }
     }
 
     if (rn != rd && (write_back || !pre_index))
     {
-        if (!pre_index)
+        if constexpr (!pre_index)
         {
             set_register(rn, (up) ? base + offset : base - offset);
         }
@@ -1297,10 +2778,9 @@ void CPU::arm_halfword_data_transfer()
     }
 }
 
+template <bool acc, bool set_c>
 void CPU::arm_multiply()
 {
-    bool acc   = ((arm_inst >> 21u) & 1u);
-    bool set_c = ((arm_inst >> 20u) & 1u);
     uint8_t rd = ((arm_inst >> 16u) & 0xfu);
     uint8_t rn = ((arm_inst >> 12u) & 0xfu);
     uint8_t rs = ((arm_inst >> 8u) & 0xfu);
@@ -1308,9 +2788,11 @@ void CPU::arm_multiply()
     uint32_t result = (acc) ? get_register(rm) * get_register(rs) + get_register(rn) :
                       get_register(rm) * get_register(rs);
 
+    cycles += multiply_cycles(get_register(rs)) + ((acc) ? 1u : 0);
+
     set_register(rd, result);
 
-    if (set_c)
+    if constexpr (set_c)
     {
         set_nz(result);
     }
@@ -1318,57 +2800,52 @@ void CPU::arm_multiply()
     // console->info("mul{} r{}, r{}, r{}, {}{}", ((acc) ? "a" : ""), rd, rm, rd, ((acc) ? "r" : ""), ((acc) ? rn : ""));
 }
 
+template <bool is_signed, bool accumulate, bool set_c>
 void CPU::arm_multiply_long()
 {
-    uint8_t is_signed_accumulate = ((arm_inst >> 22u) & 1u) << 1u | ((arm_inst >> 21u) & 1u);
-    bool set_c = ((arm_inst >> 20u) & 1u) != 0;
     uint8_t rd_hi = (arm_inst >> 16u) & 0xFu;
     uint8_t rd_lo = (arm_inst >> 12u) & 0xFu;
     uint8_t rs = (arm_inst >> 8u) & 0xFu;
     uint8_t rm = arm_inst & 0xFu;
 
-    switch (is_signed_accumulate)
+    cycles += multiply_cycles(get_register(rs)) + 1u + ((accumulate) ? 1u : 0);
+
+    if constexpr (!is_signed && !accumulate)
     {
-        case 0b00:
-            umull(rd_hi, rd_lo, rs, rm, set_c);
-            break;
-        case 0b01:
-            umlal(rd_hi, rd_lo, rs, rm, set_c);
-            break;
-        case 0b10:
-            smull(rd_hi, rd_lo, rs, rm, set_c);
-            break;
-        case 0b11:
-            smlal(rd_hi, rd_lo, rs, rm, set_c);
-            break;
-        default:
-            break;
+        umull(rd_hi, rd_lo, rs, rm, set_c);
+    }
+    else if constexpr (!is_signed && accumulate)
+    {
+        umlal(rd_hi, rd_lo, rs, rm, set_c);
+    }
+    else if constexpr (is_signed && !accumulate)
+    {
+        smull(rd_hi, rd_lo, rs, rm, set_c);
+    }
+    else
+    {
+        smlal(rd_hi, rd_lo, rs, rm, set_c);
     }
 }
 
+template <bool reg_offset, bool pre_index, bool up, bool byte, bool write_back, bool load, uint32_t shift_mode>
 void CPU::arm_single_data_transfer()
 {
-    bool reg_offset = ((arm_inst >> 25u) & 1u) != 0;
-    bool pre_index  = ((arm_inst >> 24u) & 1u) != 0;
-    bool up   = ((arm_inst >> 23u) & 1u) != 0;
-    bool byte = ((arm_inst >> 22u) & 1u) != 0;
-    bool write_back = ((arm_inst >> 21u) & 1u) != 0;
-    bool load = ((arm_inst >> 20u) & 1u) != 0;
     uint8_t rn = (arm_inst >> 16u) & 0xFu;
     uint8_t rd = (arm_inst >> 12u) & 0xFu;
     uint32_t offset;
     uint32_t base = get_register(rn);
 
-    if (reg_offset)
+    if constexpr (reg_offset)
     {
-        offset = barrel_shifter(true, false, arm_inst & 0xfffu);
+        offset = barrel_shifter<true, false, shift_mode>(arm_inst & 0xfffu);
     }
     else
     {
         offset = arm_inst & 0xFFFu;
     }
 
-    if (pre_index)
+    if constexpr (pre_index)
     {
         (up) ? base += offset : base -= offset;
     }
@@ -1377,7 +2854,7 @@ void CPU::arm_single_data_transfer()
 
     if (rn != rd && (write_back || !pre_index))
     {
-        if (!pre_index)
+        if constexpr (!pre_index)
         {
             set_register(rn, (up) ? base + offset : base - offset);
         }
@@ -1388,16 +2865,18 @@ void CPU::arm_single_data_transfer()
     }
 }
 
+template <bool byte>
 void CPU::arm_single_data_swap()
 {
-    bool byte  = ((arm_inst >> 22u) & 1u) != 0;
     uint8_t rn = (arm_inst >> 16u) & 0xFu;
     uint8_t rd = (arm_inst >> 12u) & 0xFu;
     uint8_t rm = arm_inst & 0xFu;
     uint32_t source = get_register(rm);
     uint32_t base   = get_register(rn);
 
-    if (byte)
+    cycles += 2u * mmu->get_access_cycles(base, false, !byte) + 1u;
+
+    if constexpr (byte)
     {
         set_register(rd, mmu->read8(base));
         mmu->write8(source, base);
@@ -1413,13 +2892,14 @@ void CPU::arm_single_data_swap()
 
 void CPU::adc(const uint32_t a, const uint32_t b, const uint8_t rd, const bool set_c)
 {
-    uint32_t result = a + b + (uint32_t)regs.cpsr.carry;
+    uint32_t carry  = get_carry();
+    uint32_t result = a + b + carry;
 
     set_register(rd, result);
 
     if (set_c)
     {
-        set_nzcv_add(a, b + (uint32_t)regs.cpsr.carry, result);
+        set_nzcv_add(a, b + carry, result);
     }
 
     //console->info("adc r{}, #{}, #{}", rd, a, b);
@@ -1554,13 +3034,14 @@ void CPU::logical_or(const uint32_t a, const uint32_t b, const uint8_t rd, const
 
 void CPU::sbc(const uint32_t a, const uint32_t b, const uint8_t rd, const bool change_flags)
 {
-    uint32_t result = a - b + (uint32_t)regs.cpsr.carry - 1u;
+    uint32_t carry  = get_carry();
+    uint32_t result = a - b + carry - 1u;
 
     set_register(rd, result);
 
     if (change_flags)
     {
-        set_nzcv_sub(a, b + (uint32_t)regs.cpsr.carry - 1u, result);
+        set_nzcv_sub(a, b + carry - 1u, result);
     }
 
     //console->info("sbc r{}, #{}, #{}", rd, a, b);
@@ -1677,6 +3158,8 @@ void CPU::ldmd(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
     uint32_t new_base = base;
     CPU_MODE old_mode = (CPU_MODE)regs.cpsr.cpu_mode;
 
+    cycles += block_transfer_cycles(base, count_bits_set(rlist)) + 1u;
+
     if (rlist == 0)
     {
         if (pre_index)
@@ -1692,23 +3175,26 @@ void CPU::ldmd(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
     {
         if (user && !r15_in_list)
         {
-            regs.cpsr.cpu_mode = CPU_MODE::User;
+            set_cpu_mode(CPU_MODE::User);
         }
 
-        for (uint16_t i = 0; i < 16; i++)
+        if (r15_in_list || !load_multiple_fast((pre_index) ? base + 4u : base, rlist))
         {
-            if ((rlist & (1u << i)) != 0)
+            for (uint16_t i = 0; i < 16; i++)
             {
-                if (pre_index)
+                if ((rlist & (1u << i)) != 0)
                 {
-                    base += 4u;
-                }
+                    if (pre_index)
+                    {
+                        base += 4u;
+                    }
 
-                set_register(i, mmu->read32(base));
+                    set_register(i, mmu->read32(base));
 
-                if (!pre_index)
-                {
-                    base += 4u;
+                    if (!pre_index)
+                    {
+                        base += 4u;
+                    }
                 }
             }
         }
@@ -1720,7 +3206,7 @@ void CPU::ldmd(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
 
         if (user && !r15_in_list)
         {
-            regs.cpsr.cpu_mode = old_mode;
+            set_cpu_mode(old_mode);
         }
     }
 
@@ -1742,6 +3228,8 @@ void CPU::ldmi(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
 
     static uint64_t c;
 
+    cycles += block_transfer_cycles(base, count_bits_set(rlist)) + 1u;
+
     if (rlist == 0)
     {
         if (pre_index)
@@ -1757,23 +3245,26 @@ void CPU::ldmi(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
     {
         if (user && !r15_in_list)
         {
-            regs.cpsr.cpu_mode = CPU_MODE::User;
+            set_cpu_mode(CPU_MODE::User);
         }
 
-        for (uint16_t i = 0; i < 16; i++)
+        if (r15_in_list || !load_multiple_fast((pre_index) ? base + 4u : base, rlist))
         {
-            if ((rlist & (1u << i)) != 0)
+            for (uint16_t i = 0; i < 16; i++)
             {
-                if (pre_index)
+                if ((rlist & (1u << i)) != 0)
                 {
-                    base += 4u;
-                }
+                    if (pre_index)
+                    {
+                        base += 4u;
+                    }
 
-                set_register(i, mmu->read32(base));
+                    set_register(i, mmu->read32(base));
 
-                if (!pre_index)
-                {
-                    base += 4u;
+                    if (!pre_index)
+                    {
+                        base += 4u;
+                    }
                 }
             }
         }
@@ -1785,7 +3276,7 @@ void CPU::ldmi(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
 
         if (user && !r15_in_list)
         {
-            regs.cpsr.cpu_mode = old_mode;
+            set_cpu_mode(old_mode);
         }
     }
 
@@ -1806,6 +3297,8 @@ void CPU::stmd(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
     uint32_t new_base = base;
     CPU_MODE old_mode = (CPU_MODE)regs.cpsr.cpu_mode;
 
+    cycles += block_transfer_cycles(base, count_bits_set(rlist));
+
     if (rlist == 0)
     {
         if (pre_index)
@@ -1821,46 +3314,51 @@ void CPU::stmd(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
     {
         if (user)
         {
-            regs.cpsr.cpu_mode = CPU_MODE::User;
+            set_cpu_mode(CPU_MODE::User);
         }
 
         uint32_t first_in_list = first_bit_set(rlist);
 
-        for (uint16_t i = 0; i < 16; i++)
+        // The fast path stores the old base, which is only right if rn is the first register in the list
+        if ((rlist & 0x8000u) != 0 || ((rlist & (1u << rn)) != 0 && rn != first_in_list) ||
+            !store_multiple_fast((pre_index) ? base + 4u : base, rlist))
         {
-            if ((rlist & (1u << i)) != 0)
+            for (uint16_t i = 0; i < 16; i++)
             {
-                if (pre_index)
+                if ((rlist & (1u << i)) != 0)
                 {
-                    base += 4u;
-                }
+                    if (pre_index)
+                    {
+                        base += 4u;
+                    }
 
-                if (i == rn && rn != first_in_list)
-                {
-                    mmu->write32(new_base, base);
-                }
-                else
-                {
-                    if (i == 15)
+                    if (i == rn && rn != first_in_list)
                     {
-                        mmu->write32(get_pc_prefetch() + 4u, base);
+                        mmu->write32(new_base, base);
                     }
                     else
                     {
-                        mmu->write32(get_register(i), base);
+                        if (i == 15)
+                        {
+                            mmu->write32(get_pc_prefetch() + 4u, base);
+                        }
+                        else
+                        {
+                            mmu->write32(get_register(i), base);
+                        }
                     }
-                }
 
-                if (!pre_index)
-                {
-                    base += 4u;
+                    if (!pre_index)
+                    {
+                        base += 4u;
+                    }
                 }
             }
         }
 
         if (user)
         {
-            regs.cpsr.cpu_mode = old_mode;
+            set_cpu_mode(old_mode);
         }
     }
 
@@ -1879,6 +3377,8 @@ void CPU::stmi(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
     uint32_t new_base = base + count_bits_set(rlist) * 4u;
     CPU_MODE old_mode = (CPU_MODE)regs.cpsr.cpu_mode;
 
+    cycles += block_transfer_cycles(base, count_bits_set(rlist));
+
     if (rlist == 0)
     {
         if (pre_index)
@@ -1894,46 +3394,51 @@ void CPU::stmi(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
     {
         if (user)
         {
-            regs.cpsr.cpu_mode = CPU_MODE::User;
+            set_cpu_mode(CPU_MODE::User);
         }
 
         uint32_t first_in_list = first_bit_set(rlist);
 
-        for (uint16_t i = 0; i < 16; i++)
+        // The fast path stores the old base, which is only right if rn is the first register in the list
+        if ((rlist & 0x8000u) != 0 || ((rlist & (1u << rn)) != 0 && rn != first_in_list) ||
+            !store_multiple_fast((pre_index) ? base + 4u : base, rlist))
         {
-            if ((rlist & (1u << i)) != 0)
+            for (uint16_t i = 0; i < 16; i++)
             {
-                if (pre_index)
+                if ((rlist & (1u << i)) != 0)
                 {
-                    base += 4u;
-                }
+                    if (pre_index)
+                    {
+                        base += 4u;
+                    }
 
-                if (i == rn && rn != first_in_list)
-                {
-                    mmu->write32(new_base, base);
-                }
-                else
-                {
-                    if (i == 15)
+                    if (i == rn && rn != first_in_list)
                     {
-                        mmu->write32(get_pc_prefetch() + 4u, base);
+                        mmu->write32(new_base, base);
                     }
                     else
                     {
-                        mmu->write32(get_register(i), base);
+                        if (i == 15)
+                        {
+                            mmu->write32(get_pc_prefetch() + 4u, base);
+                        }
+                        else
+                        {
+                            mmu->write32(get_register(i), base);
+                        }
                     }
-                }
 
-                if (!pre_index)
-                {
-                    base += 4u;
+                    if (!pre_index)
+                    {
+                        base += 4u;
+                    }
                 }
             }
         }
 
         if (user)
         {
-            regs.cpsr.cpu_mode = old_mode;
+            set_cpu_mode(old_mode);
         }
     }
 
@@ -1946,15 +3451,14 @@ void CPU::stmi(const uint8_t rn, const uint16_t rlist, const bool pre_index, con
     //        rlist, ((user) ? "^" : ""));
 }
 
+template <bool imm, bool op>
 void CPU::thumb_add()
 {
-    bool imm = ((thumb_inst >> 10u) & 1u) != 0;
-    bool op  = ((thumb_inst >> 9u) & 1u) != 0;
     uint32_t value = (imm) ? (thumb_inst >> 6u) & 7u : get_register((thumb_inst >> 6u) & 7u);
     uint8_t rs = (thumb_inst >> 3u) & 7u;
     uint8_t rd = thumb_inst & 7u;
 
-    if (op)
+    if constexpr (op)
     {
         sub(get_register(rs), value, rd, true);
     }
@@ -1964,11 +3468,12 @@ void CPU::thumb_add()
     }
 }
 
+template <bool negative>
 void CPU::thumb_add_offset_to_sp()
 {
     uint16_t sword8 = (thumb_inst & 0x7Fu) << 2u;
 
-    if ((thumb_inst & 0x80u) != 0)
+    if constexpr (negative)
     {
         set_register(13, get_register(13) - sword8);
     }
@@ -1978,71 +3483,85 @@ void CPU::thumb_add_offset_to_sp()
     }
 }
 
+template <uint32_t op>
 void CPU::thumb_alu()
 {
-    uint8_t op = (thumb_inst >> 6u) & 0xFu;
     uint8_t rs = (thumb_inst >> 3u) & 7u;
     uint8_t rd = thumb_inst & 7u;
 
-    switch (op)
+    if constexpr (op == 0b0000)
     {
-        case 0b0000:
-            logical_and(get_register(rd), get_register(rs), rd, true);
-            break;
-        case 0b0001:
-            logical_eor(get_register(rd), get_register(rs), rd, true);
-            break;
-        case 0b0010:
-            set_register(rd, logical_shift_left(get_register(rd), get_register(rs) & 0xFFu, true, false));
-            set_nz(get_register(rd));
-            break;
-        case 0b0011:
-            set_register(rd, logical_shift_right(get_register(rd), get_register(rs) & 0xFFu, true, false));
-            set_nz(get_register(rd));
-            break;
-        case 0b0100:
-            set_register(rd, arithmetic_shift_right(get_register(rd), get_register(rs) & 0xFFu, true, false));
-            set_nz(get_register(rd));
-            break;
-        case 0b0101:
-            adc(get_register(rd), get_register(rs), rd, true);
-            break;
-        case 0b0110:
-            sbc(get_register(rd), get_register(rs), rd, true);
-            break;
-        case 0b0111:
-            set_register(rd, rotate_right(get_register(rd), get_register(rs) & 0xFFu, true, false));
-            set_nz(get_register(rd));
-            break;
-        case 0b1001:
-            sub(0, get_register(rs), rd, true);
-            break;
-        case 0b1010:
-            cmp(get_register(rd), get_register(rs));
-            break;
-        case 0b1011:
-            cmn(get_register(rd), get_register(rs));
-            break;
-        case 0b1100:
-            logical_or(get_register(rd), get_register(rs), rd, true);
-            break;
-        case 0b1101:
-            thumb_multiply(get_register(rd), get_register(rs), rd, true);
-            break;
-        case 0b1110:
-            bic(get_register(rd), get_register(rs), rd, true);
-            break;
-        case 0b1111:
-            mov(~get_register(rs), rd, true);
-            break;
-        default:
-            break;
+        logical_and(get_register(rd), get_register(rs), rd, true);
+    }
+    else if constexpr (op == 0b0001)
+    {
+        logical_eor(get_register(rd), get_register(rs), rd, true);
+    }
+    else if constexpr (op == 0b0010)
+    {
+        ++cycles;
+        set_register(rd, logical_shift_left(get_register(rd), get_register(rs) & 0xFFu, true, false));
+        set_nz(get_register(rd));
+    }
+    else if constexpr (op == 0b0011)
+    {
+        ++cycles;
+        set_register(rd, logical_shift_right(get_register(rd), get_register(rs) & 0xFFu, true, false));
+        set_nz(get_register(rd));
+    }
+    else if constexpr (op == 0b0100)
+    {
+        ++cycles;
+        set_register(rd, arithmetic_shift_right(get_register(rd), get_register(rs) & 0xFFu, true, false));
+        set_nz(get_register(rd));
+    }
+    else if constexpr (op == 0b0101)
+    {
+        adc(get_register(rd), get_register(rs), rd, true);
+    }
+    else if constexpr (op == 0b0110)
+    {
+        sbc(get_register(rd), get_register(rs), rd, true);
+    }
+    else if constexpr (op == 0b0111)
+    {
+        ++cycles;
+        set_register(rd, rotate_right(get_register(rd), get_register(rs) & 0xFFu, true, false));
+        set_nz(get_register(rd));
+    }
+    else if constexpr (op == 0b1001)
+    {
+        sub(0, get_register(rs), rd, true);
+    }
+    else if constexpr (op == 0b1010)
+    {
+        cmp(get_register(rd), get_register(rs));
+    }
+    else if constexpr (op == 0b1011)
+    {
+        cmn(get_register(rd), get_register(rs));
+    }
+    else if constexpr (op == 0b1100)
+    {
+        logical_or(get_register(rd), get_register(rs), rd, true);
+    }
+    else if constexpr (op == 0b1101)
+    {
+        thumb_multiply(get_register(rd), get_register(rs), rd, true);
+    }
+    else if constexpr (op == 0b1110)
+    {
+        bic(get_register(rd), get_register(rs), rd, true);
+    }
+    else if constexpr (op == 0b1111)
+    {
+        mov(~get_register(rs), rd, true);
     }
 }
 
+template <uint8_t c_code>
 void CPU::thumb_conditional_branch()
 {
-    uint8_t c_code = thumb_op & 0xFu;
     int16_t s_offset8 = (int16_t)(int8_t)(thumb_inst & 0xFFu) << 1;
     uint32_t target_addr = get_pc_prefetch() + s_offset8;
 
@@ -2054,36 +3573,33 @@ void CPU::thumb_conditional_branch()
     //console->info("b{} ${:08X}", get_c_code(c_code), target_addr);
 }
 
+template <uint32_t op, bool h1, bool h2>
 void CPU::thumb_hi_register()
 {
-    uint8_t op = thumb_op & 3u;
-    bool h1 = ((thumb_inst >> 7u) & 1u) != 0;
-    bool h2 = ((thumb_inst >> 6u) & 1u) != 0;
     uint8_t rs = ((thumb_inst >> 3u) & 7u) + ((h2) ? 8u : 0u);
     uint8_t rd = (thumb_inst & 7u) + ((h1) ? 8u : 0u);
 
-    switch (op)
+    if constexpr (op == 0b00)
     {
-        case 0b00:
-            add(get_register(rd), get_register(rs), rd, false);
-            break;
-        case 0b01:
-            cmp(get_register(rd), get_register(rs));
-            break;
-        case 0b10:
-            mov(get_register(rs), rd, false);
-            break;
-        case 0b11:
-            thumb_branch_and_exchange(rs);
-            break;
-        default:
-            break;
+        add(get_register(rd), get_register(rs), rd, false);
+    }
+    else if constexpr (op == 0b01)
+    {
+        cmp(get_register(rd), get_register(rs));
+    }
+    else if constexpr (op == 0b10)
+    {
+        mov(get_register(rs), rd, false);
+    }
+    else
+    {
+        thumb_branch_and_exchange(rs);
     }
 }
 
+template <bool sp>
 void CPU::thumb_load_address()
 {
-    bool sp    = ((thumb_inst >> 11u) & 1u) != 0;
     uint8_t rd = (thumb_inst >> 8u) & 7u;
     uint32_t word8  = (thumb_inst & 0xFFu) << 2u;
     uint32_t source = ((sp) ? get_register(13) : get_pc_prefetch() & 0xFFFFFFFDu);
@@ -2091,15 +3607,17 @@ void CPU::thumb_load_address()
     set_register(rd, source + word8);
 }
 
+template <bool load>
 void CPU::thumb_load_halfword()
 {
-    bool load  = ((thumb_inst >> 11u) & 1u) != 0;
     uint16_t offset5 = ((thumb_inst >> 6u) & 0x1Fu) << 1u;
     uint8_t rb = (thumb_inst >> 3u) & 7u;
     uint8_t rd = thumb_inst & 7u;
     uint32_t base = get_register(rb) + offset5;
 
-    if (load)
+    cycles += mmu->get_access_cycles(base, false, false) + ((load) ? 1u : 0);
+
+    if constexpr (load)
     {
         set_register(rd, mmu->read16(base));
     }
@@ -2109,16 +3627,15 @@ void CPU::thumb_load_halfword()
     }
 }
 
+template <bool byte, bool load>
 void CPU::thumb_load_immediate_offset()
 {
-    bool byte = ((thumb_inst >> 12u) & 1u) != 0;
-    bool load = ((thumb_inst >> 11u) & 1u) != 0;
     uint16_t offset5 = (thumb_inst >> 6u) & 0x1Fu;
     uint8_t rb = (thumb_inst >> 3u) & 7u;
     uint8_t rd = thumb_inst & 7u;
     uint32_t offset_addr = get_register(rb) + ((byte) ? offset5 : offset5 << 2u);
 
-    if (load)
+    if constexpr (load)
     {
         load_register(rd, offset_addr, byte);
     }
@@ -2128,16 +3645,15 @@ void CPU::thumb_load_immediate_offset()
     }
 }
 
+template <bool load, bool byte>
 void CPU::thumb_load_register_offset()
 {
-    bool load = ((thumb_inst >> 11u) & 1u) != 0;
-    bool byte = ((thumb_inst >> 10u) & 1u) != 0;
     uint8_t ro = (thumb_inst >> 6u) & 7u;
     uint8_t rb = (thumb_inst >> 3u) & 7u;
     uint8_t rd = thumb_inst & 7u;
     uint32_t offset_addr = get_register(rb) + get_register(ro);
 
-    if (load)
+    if constexpr (load)
     {
         load_register(rd, offset_addr, byte);
     }
@@ -2147,39 +3663,41 @@ void CPU::thumb_load_register_offset()
     }
 }
 
+template <uint32_t sh>
 void CPU::thumb_load_signed_halfword()
 {
-    uint8_t sh = ((thumb_inst >> 11u) & 1u) | ((thumb_inst >> 9u) & 2u);
     uint8_t ro = (thumb_inst >> 6u) & 7u;
     uint8_t rb = (thumb_inst >> 3u) & 7u;
     uint8_t rd = thumb_inst & 7u;
     uint32_t base = get_register(rb) + get_register(ro);
 
-    switch (sh)
+    cycles += mmu->get_access_cycles(base, false, false) + ((sh != 0) ? 1u : 0);
+
+    if constexpr (sh == 0b00)
     {
-        case 0b00:
-            mmu->write16(get_register(rd), base);
-            break;
-        case 0b01:
-            set_register(rd, mmu->read16(base));
-            break;
-        case 0b10:
-            set_register(rd, (int32_t)(int8_t)mmu->read8(base));
-            break;
-        case 0b11:
-            set_register(rd, (int32_t)(int16_t)mmu->read16(base));
-            break;
-        default:
-            break;
+        mmu->write16(get_register(rd), base);
+    }
+    else if constexpr (sh == 0b01)
+    {
+        set_register(rd, mmu->read16(base));
+    }
+    else if constexpr (sh == 0b10)
+    {
+        set_register(rd, (int32_t)(int8_t)mmu->read8(base));
+    }
+    else
+    {
+        set_register(rd, (int32_t)(int16_t)mmu->read16(base));
     }
 }
 
+template <bool high>
 void CPU::thumb_long_branch()
 {
     uint32_t offset = thumb_inst & 0x7FFu;
     uint32_t temp;
 
-    if ((thumb_inst & 0x800u) == 0)
+    if constexpr (!high)
     {
         offset <<= 12u;
 
@@ -2203,71 +3721,67 @@ void CPU::thumb_long_branch()
     }
 }
 
+template <uint32_t op>
 void CPU::thumb_move_immediate()
 {
-    uint8_t op = (thumb_inst >> 11u) & 3u;
     uint8_t rd = (thumb_inst >> 8u) & 7u;
     uint8_t offset8 = thumb_inst & 0xFFu;
 
-    switch (op)
+    if constexpr (op == 0b00)
     {
-        case 0b00:
-            mov(offset8, rd, true);
-            break;
-        case 0b01:
-            cmp(get_register(rd), offset8);
-            break;
-        case 0b10:
-            add(get_register(rd), offset8, rd, true);
-            break;
-        case 0b11:
-            sub(get_register(rd), offset8, rd, true);
-            break;
-        default:
-            break;
+        mov(offset8, rd, true);
+    }
+    else if constexpr (op == 0b01)
+    {
+        cmp(get_register(rd), offset8);
+    }
+    else if constexpr (op == 0b10)
+    {
+        add(get_register(rd), offset8, rd, true);
+    }
+    else
+    {
+        sub(get_register(rd), offset8, rd, true);
     }
 }
 
+template <uint32_t op>
 void CPU::thumb_move_shifted_register()
 {
-    uint8_t op = (thumb_inst >> 11u) & 3u;
     uint8_t offset5 = (thumb_inst >> 6u) & 0x1Fu;
     uint8_t rs = (thumb_inst >> 3u) & 7u;
     uint8_t rd = thumb_inst & 7u;
 
-    switch (op)
+    if constexpr (op == 0b00)
     {
-        case 0b00:
-            //console->info("lsl r{}, r{}, #{}", rd, rs, offset5);
+        //console->info("lsl r{}, r{}, #{}", rd, rs, offset5);
 
-            set_register(rd, logical_shift_left(get_register(rs), offset5, true, true));
-            break;
-        case 0b01:
-            //console->info("lsr r{}, r{}, #{}", rd, rs, offset5);
+        set_register(rd, logical_shift_left(get_register(rs), offset5, true, true));
+    }
+    else if constexpr (op == 0b01)
+    {
+        //console->info("lsr r{}, r{}, #{}", rd, rs, offset5);
 
-            set_register(rd, logical_shift_right(get_register(rs), offset5, true, true));
-            break;
-        case 0b10:
-            //console->info("asr r{}, r{}, #{}", rd, rs, offset5);
+        set_register(rd, logical_shift_right(get_register(rs), offset5, true, true));
+    }
+    else
+    {
+        static_assert(op == 0b10, "Invalid shift, ROR not available!");
 
-            set_register(rd, arithmetic_shift_right(get_register(rs), offset5, true, true));
-            break;
-        default:
-            console->error("Invalid shift, ROR not available!");
+        //console->info("asr r{}, r{}, #{}", rd, rs, offset5);
 
-            throw std::runtime_error("Invalid shift!");
+        set_register(rd, arithmetic_shift_right(get_register(rs), offset5, true, true));
     }
 
     set_nz(get_register(rd));
 }
 
+template <bool load, uint8_t rb>
 void CPU::thumb_multiple_load()
 {
-    bool load  = (thumb_op & 8u) != 0;
-    uint8_t rb = thumb_op & 7u;
     uint8_t rlist = thumb_inst & 0xFFu;
 
-    if (load)
+    if constexpr (load)
     {
         thumb_ldmia(rb, rlist);
     }
@@ -2285,13 +3799,12 @@ void CPU::thumb_pc_relative_load()
     load_register(rd, (get_pc_prefetch() & 0xFFFFFFFDu) + word8, false);
 }
 
+template <bool load, bool load_pc_lr>
 void CPU::thumb_push_registers()
 {
-    bool load = ((thumb_inst >> 11u) & 1u) != 0;
-    bool load_pc_lr = ((thumb_inst >> 8u) & 1u) != 0;
     uint8_t rlist = thumb_inst & 0xFFu;
 
-    if (load)
+    if constexpr (load)
     {
         thumb_pop(rlist, load_pc_lr);
     }
@@ -2301,18 +3814,20 @@ void CPU::thumb_push_registers()
     }
 }
 
+template <bool load>
 void CPU::thumb_sp_relative_load()
 {
-    bool load  = ((thumb_inst >> 11u) & 1u) != 0;
     uint8_t rd = (thumb_inst >> 8u) & 7u;
     uint16_t word8 = (thumb_inst & 0xFFu) << 2u;
 
-    if (load)
+    if constexpr (load)
     {
         load_register(rd, get_register(13) + word8, false);
     }
     else
     {
+        cycles += mmu->get_access_cycles(get_register(13) + word8, false, true);
+
         mmu->write32(get_register(rd), get_register(13) + word8);
     }
 }
@@ -2329,6 +3844,69 @@ void CPU::thumb_unconditional_branch()
     set_register(15, get_pc_prefetch() + offset11);
 }
 
+void CPU::thumb_fused_long_branch()
+{
+    thumb_long_branch<false>();
+
+    if (fetch_fused_instruction())
+    {
+        thumb_long_branch<true>();
+    }
+}
+
+void CPU::thumb_fused_load_branch_exchange()
+{
+    thumb_pc_relative_load();
+
+    if (fetch_fused_instruction())
+    {
+        thumb_branch_and_exchange((thumb_inst >> 3u) & 7u);
+    }
+}
+
+template <bool imm>
+void CPU::thumb_fused_compare_branch()
+{
+    uint32_t a = get_register((imm) ? (thumb_inst >> 8u) & 7u : thumb_inst & 7u);
+    uint32_t b = (imm) ? thumb_inst & 0xFFu : get_register((thumb_inst >> 3u) & 7u);
+
+    cmp(a, b);
+
+    if (fetch_fused_instruction() && is_condition_sub(a, b, (thumb_inst >> 8u) & 0xFu))
+    {
+        int16_t s_offset8 = (int16_t)(int8_t)(thumb_inst & 0xFFu) << 1;
+
+        set_register(15, get_pc_prefetch() + s_offset8);
+    }
+}
+
+// The intermediate result and the flags of the LSL are overwritten by the second shift, so they're skipped
+template <bool sign>
+void CPU::thumb_fused_extend()
+{
+    uint32_t value = get_register((thumb_inst >> 3u) & 7u) << ((thumb_inst >> 6u) & 0x1Fu);
+    uint8_t amount = (thumb_inst_fused >> 6u) & 0x1Fu;
+    uint8_t rd = thumb_inst & 7u;
+
+    if (!fetch_fused_instruction())
+    {
+        thumb_move_shifted_register<0b00>();
+
+        return;
+    }
+
+    if constexpr (sign)
+    {
+        set_register(rd, arithmetic_shift_right(value, amount, true, true));
+    }
+    else
+    {
+        set_register(rd, logical_shift_right(value, amount, true, true));
+    }
+
+    set_nz(get_register(rd));
+}
+
 void CPU::thumb_branch_and_exchange(const uint8_t rs)
 {
     uint32_t target_addr = get_register(rs);
@@ -2343,6 +3921,8 @@ void CPU::thumb_multiply(const uint32_t a, const uint32_t b, const uint8_t rd, c
 {
     uint32_t result = a * b;
 
+    cycles += multiply_cycles(b);
+
     set_register(rd, result);
 
     if (set_c)
@@ -2356,6 +3936,8 @@ void CPU::thumb_ldmia(const uint8_t rb, const uint8_t rlist)
     uint32_t base = get_register(rb);
     uint32_t new_base;
 
+    cycles += block_transfer_cycles(base, count_bits_set(rlist)) + 1u;
+
     if (rlist == 0)
     {
         set_register(15, mmu->read32(base));
@@ -2366,13 +3948,16 @@ void CPU::thumb_ldmia(const uint8_t rb, const uint8_t rlist)
     {
         new_base = base + (count_bits_set(rlist) * 4u);
 
-        for (uint16_t i = 0; i < 16; i++)
+        if (!load_multiple_fast(base, rlist))
         {
-            if ((rlist & (1u << i)) != 0)
+            for (uint16_t i = 0; i < 16; i++)
             {
-                set_register(i, mmu->read32(base));
+                if ((rlist & (1u << i)) != 0)
+                {
+                    set_register(i, mmu->read32(base));
 
-                base += 4u;
+                    base += 4u;
+                }
             }
         }
     }
@@ -2390,6 +3975,8 @@ void CPU::thumb_stmia(const uint8_t rb, const uint8_t rlist)
     uint32_t base = get_register(rb);
     uint32_t new_base;
 
+    cycles += block_transfer_cycles(base, count_bits_set(rlist));
+
     if (rlist == 0)
     {
         mmu->write32(get_pc_prefetch(), base);
@@ -2401,20 +3988,23 @@ void CPU::thumb_stmia(const uint8_t rb, const uint8_t rlist)
         uint32_t first_in_list = first_bit_set(rlist);
         new_base = base + (count_bits_set(rlist) * 4u);
 
-        for (uint16_t i = 0; i < 8; i++)
+        if (((rlist & (1u << rb)) != 0 && rb != first_in_list) || !store_multiple_fast(base, rlist))
         {
-            if ((rlist & (1u << i)) != 0)
+            for (uint16_t i = 0; i < 8; i++)
             {
-                if (i == rb && rb != first_in_list)
+                if ((rlist & (1u << i)) != 0)
                 {
-                    mmu->write32(new_base, base);
-                }
-                else
-                {
-                    mmu->write32(get_register(i), base);
-                }
+                    if (i == rb && rb != first_in_list)
+                    {
+                        mmu->write32(new_base, base);
+                    }
+                    else
+                    {
+                        mmu->write32(get_register(i), base);
+                    }
 
-                base += 4u;
+                    base += 4u;
+                }
             }
         }
     }
@@ -2430,28 +4020,33 @@ void CPU::thumb_push(const uint8_t rlist, const bool lr)
     uint32_t base = old_base - (count_bits_set(rlist) * 4u + ((lr) ? 4u : 0u));
     uint32_t new_base = base;
 
-    for (uint16_t i = 0; i < 8; i++)
+    cycles += block_transfer_cycles(base, count_bits_set(rlist) + ((lr) ? 1u : 0));
+
+    if (!store_multiple_fast(base, rlist | ((lr) ? 0x4000u : 0)))
     {
-        if ((rlist & (1u << i)) != 0)
+        for (uint16_t i = 0; i < 8; i++)
         {
-            mmu->write32(get_register(i), base);
+            if ((rlist & (1u << i)) != 0)
+            {
+                mmu->write32(get_register(i), base);
 
-            base += 4u;
+                base += 4u;
+            }
         }
-    }
 
-    if (lr)
-    {
-        mmu->write32(get_register(14), base);
+        if (lr)
+        {
+            mmu->write32(get_register(14), base);
 
-        base += 4u;
-    }
+            base += 4u;
+        }
 
-    if (base != old_base)
-    {
-        console->critical("stmdb: new base doesn't match old base!");
+        if (base != old_base)
+        {
+            console->critical("stmdb: new base doesn't match old base!");
 
-        throw std::runtime_error("New base doesn't match old base!");
+            throw std::runtime_error("New base doesn't match old base!");
+        }
     }
 
     set_register(13, new_base);
@@ -2464,13 +4059,22 @@ void CPU::thumb_pop(const uint8_t rlist, const bool pc)
     uint32_t base = get_register(13);
     uint32_t new_base = base + (count_bits_set(rlist) * 4u);
 
-    for (uint16_t i = 0; i < 8; i++)
+    cycles += block_transfer_cycles(base, count_bits_set(rlist) + ((pc) ? 1u : 0)) + 1u;
+
+    if (load_multiple_fast(base, rlist))
     {
-        if ((rlist & (1u << i)) != 0)
+        base = new_base;
+    }
+    else
+    {
+        for (uint16_t i = 0; i < 8; i++)
         {
-            set_register(i, mmu->read32(base));
+            if ((rlist & (1u << i)) != 0)
+            {
+                set_register(i, mmu->read32(base));
 
-            base += 4u;
+                base += 4u;
+            }
         }
     }
 
@@ -2497,17 +4101,197 @@ void CPU::dump_registers() const
             get_register(13), get_register(14), get_register(15), get_cpsr(), get_cpsr_flags());
 }
 
+void CPU::set_engine(const CPU_ENGINE new_engine)
+{
+    engine = new_engine;
+
+    if ((engine == CPU_ENGINE::Native || engine == CPU_ENGINE::Native_Checked) && !JIT::is_supported())
+    {
+        console->warn("The JIT needs an x86-64 host, running cached blocks instead");
+
+        engine = CPU_ENGINE::Cached;
+    }
+
+    // Blocks may be stale if the cache was bypassed while WRAM code was rewritten
+    block_cache.clear();
+    code_pages.clear();
+
+    mmu->clear_code_pages();
+
+    if (engine == CPU_ENGINE::Native || engine == CPU_ENGINE::Native_Checked)
+    {
+        if (!jit)
+        {
+            jit = std::make_unique<JIT>(this);
+        }
+
+        jit->flush();
+        jit->set_checked(engine == CPU_ENGINE::Native_Checked);
+    }
+}
+
+// Runs instructions back to back until the next event is due or an interrupt becomes pending
+void CPU::run_interpreter()
+{
+#if defined(__GNUC__)
+    // Each handler ends in its own indirect jump, which predicts far better than one shared dispatch point
+    static void *const state_labels[2] = { &&arm_state, &&thumb_state };
+
+#define NEXT_INSTRUCTION()                                                                                \
+    scheduler->add_cycles(cycles);                                                                        \
+                                                                                                          \
+    if (scheduler->is_event_due() || is_interrupt_pending() || power_state != POWER_STATE::Power_Running) \
+    {                                                                                                     \
+        return;                                                                                           \
+    }                                                                                                     \
+                                                                                                          \
+    goto *state_labels[regs.cpsr.thumb_state]
+
+    goto *state_labels[regs.cpsr.thumb_state];
+
+arm_state:
+    cycles = 0;
+
+    PROFILE_INSTRUCTION();
+
+    decode_arm();
+
+    NEXT_INSTRUCTION();
+
+thumb_state:
+    cycles = 0;
+
+    PROFILE_INSTRUCTION();
+
+    decode_thumb();
+
+    NEXT_INSTRUCTION();
+
+#undef NEXT_INSTRUCTION
+#else
+    do
+    {
+        cycles = 0;
+
+        PROFILE_INSTRUCTION();
+
+        if (regs.cpsr.thumb_state)
+        {
+            decode_thumb();
+        }
+        else
+        {
+            decode_arm();
+        }
+
+        scheduler->add_cycles(cycles);
+    } while (!scheduler->is_event_due() && !is_interrupt_pending() && power_state == POWER_STATE::Power_Running);
+#endif
+}
+
+void CPU::halt(const bool stop)
+{
+    power_state = (stop) ? POWER_STATE::Power_Stop : POWER_STATE::Power_Halt;
+}
+
+void CPU::set_hle_swi(const bool enabled)
+{
+    hle_swi = enabled;
+}
+
+void CPU::add_idle_loop(const uint32_t address)
+{
+    known_idle_loops.insert(address);
+
+    // Blocks compiled before the table was loaded
+    for (uint32_t thumb = 0; thumb < 2; thumb++)
+    {
+        auto block = block_cache.find(address | thumb);
+
+        if (block != block_cache.end())
+        {
+            block->second.idle_loop = IDLE_LOOP::Idle_Known;
+        }
+    }
+}
+
+void CPU::set_idle_skip(const bool enabled)
+{
+    idle_skip = enabled;
+}
+
+void CPU::start_predecode()
+{
+    if (engine == CPU_ENGINE::Interpreter || predecode_thread.joinable())
+    {
+        return;
+    }
+
+    uint32_t rom_size = (uint32_t)mmu->cart->cart_bounds;
+
+    predecode_pending = true;
+    predecode_thread  = std::thread(&CPU::predecode_rom, this, std::cref(mmu->cart->data), rom_size);
+}
+
 void CPU::run()
 {
-    if ((mmu->interrupt_master_enable & 1u) == 1 && !regs.cpsr.irq_disable)
+    while (scheduler->get_timestamp() < scheduler->get_next_event())
     {
-        if ((mmu->interrupt_enable & mmu->interrupt_request_flags) != 0)
+        if (power_state != POWER_STATE::Power_Running)
+        {
+            // Only events raise interrupts, so nothing happens until the next one
+            if (!is_wake_up_pending())
+            {
+                scheduler->add_cycles(scheduler->get_next_event() - scheduler->get_timestamp());
+                break;
+            }
+
+            power_state = POWER_STATE::Power_Running;
+        }
+
+        if (is_interrupt_pending())
         {
+            cycles = 0;
+
             hardware_interrupt();
-            return;
+
+            scheduler->add_cycles(cycles);
+            continue;
         }
-    }
 
-    (this->*state_table[regs.cpsr.thumb_state])();
-    //dump_registers();
+        if (engine == CPU_ENGINE::Interpreter)
+        {
+            run_interpreter();
+            continue;
+        }
+
+        Block *block = get_block();
+
+        if (block != nullptr)
+        {
+            if (idle_skip && block->idle_loop != IDLE_LOOP::Not_Idle)
+            {
+                run_idle_loop(*block);
+            }
+            else if (engine == CPU_ENGINE::Native || engine == CPU_ENGINE::Native_Checked)
+            {
+                run_native_block(*block);
+            }
+            else
+            {
+                run_block(*block);
+            }
+        }
+        else
+        {
+            cycles = 0;
+
+            PROFILE_INSTRUCTION();
+
+            (this->*state_table[regs.cpsr.thumb_state])();
+            //dump_registers();
+
+            scheduler->add_cycles(cycles);
+        }
+    }
 }
@@ -21,35 +21,101 @@
 #define AMAZINGLY_ADVANCED_CPU_H
 
 
+#include "cpu_blocks.h"
 #include "cpu_modes.h"
 #include "cpu_registers.h"
 
 #include "../utils/log.h"
 
 #include <array>
+#include <atomic>
+#include <exception>
 #include <memory>
-
+#include <thread>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Interrupts;
+class JIT;
 class MMU;
+class Scheduler;
 
 class CPU
 {
+    friend JIT;
 private:
     std::shared_ptr<MMU> mmu;
     std::shared_ptr<spdlog::logger> console;
 
+    Scheduler *scheduler;
+    Interrupts *interrupts;
+
     CPU_Registers regs;
 
-    std::array<void (CPU::*)(), 2>    state_table;
-    std::array<void (CPU::*)(), 4096> arm_table;
-    std::array<void (CPU::*)(), 256>  thumb_table;
+    // Cycles taken by the current instruction
+    uint32_t cycles;
+
+    using Handler = void (CPU::*)();
+
+    std::array<Handler, 2> state_table;
+
+    static const std::array<Handler, 4096> arm_table;
+    static const std::array<Handler, 1024> thumb_table;
 
     uint32_t arm_inst;
     uint32_t arm_op;
     uint16_t thumb_inst;
     uint16_t thumb_op;
 
-    void fill_arm_table();
-    void fill_thumb_table();
+    // Second instruction of a fused Thumb pair
+    uint16_t thumb_inst_fused;
+
+    // Decoded blocks keyed by address | Thumb state, WRAM blocks are also listed under their code page
+    std::unordered_map<uint32_t, Block> block_cache;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> code_pages;
+
+    bool block_invalidated;
+
+    CPU_ENGINE engine;
+
+    POWER_STATE power_state;
+
+    // BIOS functions are implemented natively instead of running the BIOS code
+    bool hle_swi;
+
+    // An IntrWait is halted and will run again, old flags have already been discarded
+    bool intr_wait_pending;
+
+    // Addresses of idle loops from the per-ROM table, and whether idle loops are skipped at all
+    std::unordered_set<uint32_t> known_idle_loops;
+    bool idle_skip;
+
+    // Game Pak ROM blocks decoded ahead of time by a background thread. The ROM never changes, so they're moved
+    // into block_cache as they are once the thread is done
+    std::thread predecode_thread;
+    std::atomic<bool> predecode_done;
+    bool predecode_pending;
+    std::unordered_map<uint32_t, Block> predecoded_blocks;
+
+    // Created when a JIT engine is selected. Exceptions thrown by instructions that native code calls back into
+    // are kept here and rethrown once the native code has returned
+    std::unique_ptr<JIT> jit;
+    std::exception_ptr jit_exception;
+
+    // State before the current native instruction, only used by JIT_Checked
+    CPU_Registers jit_snapshot;
+    uint64_t jit_snapshot_timestamp;
+
+    template <uint32_t index>
+    static constexpr Handler get_arm_handler();
+    template <size_t... indices>
+    static constexpr std::array<Handler, 4096> make_arm_table(std::index_sequence<indices...>);
+    template <uint32_t index>
+    static constexpr Handler get_thumb_handler();
+    template <size_t... indices>
+    static constexpr std::array<Handler, 1024> make_thumb_table(std::index_sequence<indices...>);
 
     [[nodiscard]] inline std::string get_cpsr_flags() const;
     [[nodiscard]] inline std::string get_cpu_mode(CPU_MODE mode) const;
@@ -66,24 +132,76 @@ private:
     inline void set_spsr(uint32_t value);
     inline void set_cpu_state(bool thumb);
     inline void set_register(uint8_t index, uint32_t value);
+    inline void set_cpu_mode(CPU_MODE mode);
+    inline void bank_registers(CPU_MODE old_mode, CPU_MODE new_mode);
+
+    [[nodiscard]] inline bool get_negative() const;
+    [[nodiscard]] inline bool get_zero() const;
+    [[nodiscard]] inline bool get_carry() const;
+    [[nodiscard]] inline bool get_overflow() const;
+    [[nodiscard]] inline uint32_t get_nzcv() const;
+    inline void set_carry(bool carry);
+    inline void load_flags(uint32_t value);
 
     inline void set_nz(uint32_t value);
     inline void set_nz_long(uint64_t value);
     inline void set_nzcv_add(uint32_t a, uint32_t b, uint32_t result);
     inline void set_nzcv_sub(uint32_t a, uint32_t b, uint32_t result);
-    inline bool is_condition(uint8_t c_code);
+    [[nodiscard]] inline bool is_condition(uint8_t c_code) const;
+    [[nodiscard]] inline bool is_condition_sub(uint32_t a, uint32_t b, uint8_t c_code) const;
 
     inline void load_register(uint8_t rd, uint32_t address, bool byte);
     inline void store_register(uint8_t rd, uint32_t address, bool byte);
 
     [[nodiscard]] inline uint32_t read_word(uint32_t address) const;
 
+    inline void refill_pipeline();
+    [[nodiscard]] inline uint32_t multiply_cycles(uint32_t multiplier) const;
+    [[nodiscard]] inline uint32_t block_transfer_cycles(uint32_t address, uint32_t count) const;
+    [[nodiscard]] inline bool load_multiple_fast(uint32_t address, uint16_t rlist);
+    [[nodiscard]] inline bool store_multiple_fast(uint32_t address, uint16_t rlist);
+
     inline uint32_t fetch_arm();
     inline uint16_t fetch_thumb();
     inline void decode_arm();
     inline void decode_thumb();
 
-    inline uint32_t barrel_shifter(bool immediate, bool set_c, uint16_t operand, bool dp = false);
+    [[nodiscard]] inline bool is_interrupt_pending() const;
+    [[nodiscard]] inline bool is_wake_up_pending() const;
+    [[nodiscard]] inline bool is_block_end_arm(uint32_t instruction) const;
+    [[nodiscard]] inline bool is_block_end_thumb(uint16_t instruction) const;
+    inline Block *get_block();
+    template <typename Fetch>
+    inline void decode_block(Block &block, Fetch fetch) const;
+    [[nodiscard]] inline Handler get_fused_handler(uint16_t first, uint16_t second) const;
+    inline void fuse_thumb_pairs(Block &block) const;
+    [[nodiscard]] inline bool fetch_fused_instruction();
+    inline void compile_block(Block &block);
+    inline void execute_instruction(const Decoded_Instruction &decoded, bool thumb);
+    [[nodiscard]] inline bool run_block_instruction(const Decoded_Instruction &decoded, bool thumb,
+                                                    uint32_t next_address);
+    inline void run_block(Block &block);
+    inline void run_native_block(Block &block);
+    inline void verify_instruction(const Decoded_Instruction &decoded, bool thumb) const;
+    inline void run_interpreter();
+
+    // Called from native code, see JIT::compile
+    static bool jit_run_instruction(CPU *cpu, const Decoded_Instruction *decoded, uint32_t next_address, bool thumb);
+    static void jit_save_state(CPU *cpu);
+    static bool jit_check_instruction(CPU *cpu, const Decoded_Instruction *decoded, bool thumb);
+
+    [[nodiscard]] inline bool is_idle_instruction_arm(uint32_t instruction) const;
+    [[nodiscard]] inline bool is_idle_instruction_thumb(uint16_t instruction) const;
+    [[nodiscard]] inline IDLE_LOOP get_idle_loop(const Block &block) const;
+    inline void run_idle_loop(Block &block);
+
+    inline void predecode_rom(const std::vector<uint8_t> &rom, uint32_t rom_size);
+    inline void queue_successors(const Block &block, const std::vector<uint8_t> &rom, uint32_t rom_size,
+                                 std::vector<std::pair<uint32_t, bool>> &pending) const;
+    inline void merge_predecoded_blocks();
+
+    template <bool immediate, bool set_c, uint32_t mode>
+    inline uint32_t barrel_shifter(uint16_t operand, bool dp = false);
     inline uint32_t logical_shift_left(uint32_t value, uint8_t amount, bool set_c, bool imm);
     inline uint32_t logical_shift_right(uint32_t value, uint8_t amount, bool set_c, bool imm);
     inline uint32_t arithmetic_shift_right(uint32_t value, uint8_t amount, bool set_c, bool imm);
@@ -125,14 +243,34 @@ private:
     inline void hardware_interrupt();
     inline void software_interrupt();
 
+    [[nodiscard]] inline bool hle_software_interrupt(uint8_t number);
+    inline void hle_intr_wait(bool discard, uint16_t flags);
+    inline void hle_div(int32_t numerator, int32_t denominator);
+    inline void hle_sqrt();
+    inline void hle_arctan();
+    inline void hle_arctan2();
+    inline void hle_cpu_set();
+    inline void hle_cpu_fast_set();
+    inline void hle_bg_affine_set();
+    inline void hle_obj_affine_set();
+    inline void hle_write_output(uint32_t destination, std::vector<uint8_t> output, uint32_t unit);
+
+    template <bool pre_index, bool up, bool user, bool write_back, bool load>
     inline void arm_block_data_transfer();
+    template <bool link>
     inline void arm_branch();
     inline void arm_branch_and_exchange();
+    template <bool imm_op, uint32_t op, bool set_c, uint32_t shift>
     inline void arm_data_processing();
+    template <bool pre_index, bool up, bool imm, bool write_back, bool load, uint32_t is_signed_halfword>
     inline void arm_halfword_data_transfer();
+    template <bool acc, bool set_c>
     inline void arm_multiply();
+    template <bool is_signed, bool accumulate, bool set_c>
     inline void arm_multiply_long();
+    template <bool reg_offset, bool pre_index, bool up, bool byte, bool write_back, bool load, uint32_t shift_mode>
     inline void arm_single_data_transfer();
+    template <bool byte>
     inline void arm_single_data_swap();
 
     inline void adc(uint32_t a, uint32_t b, uint8_t rd, bool set_c);
@@ -161,25 +299,49 @@ private:
     inline void stmd(uint8_t rn, uint16_t rlist, bool pre_index, bool user, bool write_back);
     inline void stmi(uint8_t rn, uint16_t rlist, bool pre_index, bool user, bool write_back);
 
+    template <bool imm, bool op>
     inline void thumb_add();
+    template <bool negative>
     inline void thumb_add_offset_to_sp();
+    template <uint32_t op>
     inline void thumb_alu();
+    template <uint8_t c_code>
     inline void thumb_conditional_branch();
+    template <uint32_t op, bool h1, bool h2>
     inline void thumb_hi_register();
+    template <bool sp>
     inline void thumb_load_address();
+    template <bool load>
     inline void thumb_load_halfword();
+    template <bool byte, bool load>
     inline void thumb_load_immediate_offset();
+    template <bool load, bool byte>
     inline void thumb_load_register_offset();
+    template <uint32_t sh>
     inline void thumb_load_signed_halfword();
+    template <bool high>
     inline void thumb_long_branch();
+    template <uint32_t op>
     inline void thumb_move_immediate();
+    template <uint32_t op>
     inline void thumb_move_shifted_register();
+    template <bool load, uint8_t rb>
     inline void thumb_multiple_load();
     inline void thumb_pc_relative_load();
+    template <bool load, bool load_pc_lr>
     inline void thumb_push_registers();
+    template <bool load>
     inline void thumb_sp_relative_load();
     inline void thumb_unconditional_branch();
 
+    // Fused pairs, see get_fused_handler
+    inline void thumb_fused_long_branch();
+    inline void thumb_fused_load_branch_exchange();
+    template <bool imm>
+    inline void thumb_fused_compare_branch();
+    template <bool sign>
+    inline void thumb_fused_extend();
+
     inline void thumb_branch_and_exchange(uint8_t rs);
     inline void thumb_multiply(uint32_t a, uint32_t b, uint8_t rd, bool set_c);
     inline void thumb_ldmia(uint8_t rb, uint8_t rlist);
@@ -192,6 +354,19 @@ public:
     explicit CPU(const std::shared_ptr<MMU> &mmu);
     ~CPU();
 
+    // Called by the MMU when a WRAM code page is written, drops every block decoded from it
+    void invalidate_blocks(uint32_t page);
+    void set_engine(CPU_ENGINE new_engine);
+
+    void halt(bool stop);
+    void set_hle_swi(bool enabled);
+
+    void add_idle_loop(uint32_t address);
+    void set_idle_skip(bool enabled);
+
+    // Starts decoding the ROM from its entry point in the background, does nothing for the interpreter
+    void start_predecode();
+
     void run();
 };
 
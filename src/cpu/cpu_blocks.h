@@ -0,0 +1,82 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_CPU_BLOCKS_H
+#define AMAZINGLY_ADVANCED_CPU_BLOCKS_H
+
+
+#include <cinttypes>
+#include <vector>
+
+class CPU;
+
+// Interpreter fetches and decodes every instruction, Cached runs pre-decoded blocks,
+// Verified runs blocks but checks each cached instruction against memory before executing it.
+// Native runs blocks translated to x86-64 code by the JIT, Native_Checked also compares every inline instruction
+// with the interpreter
+enum CPU_ENGINE
+{
+    Interpreter,
+    Cached,
+    Verified,
+    Native,
+    Native_Checked
+};
+
+// Candidates are short loops that branch back to their own start without writing memory, they're only
+// treated as idle once an iteration leaves the CPU state unchanged. Known idle loops come from the per-ROM table
+enum IDLE_LOOP
+{
+    Not_Idle,
+    Idle_Candidate,
+    Idle_Known
+};
+
+struct Decoded_Instruction
+{
+    void (CPU::*handler)();
+
+    uint32_t instruction;
+    uint8_t  condition;
+
+    // Thumb only, the handler also runs the next instruction, which is kept in the upper halfword
+    bool fused;
+};
+
+using Native_Code = void (*)();
+
+// Straight-line run of pre-decoded instructions, ends at the first instruction that may write r15
+struct Block
+{
+    uint32_t address;
+    bool thumb;
+
+    IDLE_LOOP idle_loop;
+
+    // Iterations in a row of an idle candidate that changed the CPU state
+    uint8_t idle_misses;
+
+    std::vector<Decoded_Instruction> instructions;
+
+    // Host code for the block, compiled on its first run when the JIT is enabled
+    Native_Code native;
+};
+
+
+#endif //AMAZINGLY_ADVANCED_CPU_BLOCKS_H
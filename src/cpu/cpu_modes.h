@@ -34,5 +34,13 @@ enum CPU_MODE
     System     = 0x1F
 };
 
+// Set through HALTCNT. Halt waits for any enabled interrupt, Stop only for keypad, Game Pak and serial interrupts
+enum POWER_STATE
+{
+    Power_Running,
+    Power_Halt,
+    Power_Stop
+};
+
 
 #endif //AMAZINGLY_ADVANCED_CPU_MODES_H
@@ -41,9 +41,39 @@ union CPSR
     uint32_t cpsr;
 };
 
+// Source of the C and V flags. Stored flags are kept as is, Add and Sub flags are derived from the operands
+// of the last flag-setting addition or subtraction when they're read
+enum FLAGS_CV
+{
+    Flags_Stored,
+    Flags_Add,
+    Flags_Sub
+};
+
+// Lazily evaluated condition flags, the flag bits in CPSR are only valid in values returned by CPU::get_cpsr
+struct Lazy_Flags
+{
+    // N is bit 31 of n, Z is set if z is 0
+    uint32_t n;
+    uint32_t z;
+
+    FLAGS_CV cv;
+
+    uint32_t a;
+    uint32_t b;
+    uint32_t result;
+
+    bool carry;
+    bool overflow;
+};
+
 struct CPU_Registers
 {
-    uint32_t r_unbanked[8];
+    // r0-r14 of the current mode, r[15] is unused since pc holds the address of the next instruction
+    uint32_t r[16];
+
+    // Banked copies for the modes that aren't active, swapped with r only when the mode changes.
+    // r8-r12 are kept for non-FIQ modes ([0]) and FIQ ([1]), sp and lr are indexed by CPU::get_index
     uint32_t r_banked_fiq[5][2];
 
     uint32_t sp_banked[6];
@@ -52,6 +82,8 @@ struct CPU_Registers
 
     CPSR cpsr;
     CPSR spsr_banked[5];
+
+    Lazy_Flags flags;
 };
 
 
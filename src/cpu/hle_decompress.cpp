@@ -0,0 +1,276 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#include "hle_decompress.h"
+
+#include "../mmu/mmu.h"
+
+#include <algorithm>
+
+// Decompression SWIs collect their output in 32-bit units, lowest bits first
+static void append_word(std::vector<uint8_t> &output, const uint32_t value)
+{
+    for (uint32_t byte = 0; byte < 4; byte++)
+    {
+        output.push_back(value >> (byte * 8u));
+    }
+}
+
+std::vector<uint8_t> bios_bit_unpack(const MMU &mmu, const uint32_t source, const uint32_t info)
+{
+    uint16_t length = mmu.read16(info);
+    uint32_t source_width = mmu.read8(info + 2u);
+    uint32_t destination_width = mmu.read8(info + 3u);
+    uint32_t data_offset = mmu.read32(info + 4u);
+    bool offset_zero = (data_offset & 0x80000000u) != 0;
+
+    // Widths have to be powers of two, sources can't be wider than a byte
+    if ((source & 0xE000000u) == 0 || source_width == 0 || source_width > 8u ||
+        (source_width & (source_width - 1u)) != 0 || destination_width == 0 || destination_width > 32u ||
+        (destination_width & (destination_width - 1u)) != 0)
+    {
+        return {};
+    }
+
+    uint32_t source_mask = (1u << source_width) - 1u;
+    auto destination_mask = (uint32_t)((1ull << destination_width) - 1u);
+    std::vector<uint8_t> output;
+    uint32_t buffer = 0;
+    uint32_t buffered = 0;
+
+    output.reserve(length * (destination_width / source_width));
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        uint8_t data = mmu.read8(source + i);
+
+        for (uint32_t bit = 0; bit < 8u; bit += source_width)
+        {
+            uint32_t value = (data >> bit) & source_mask;
+
+            if (value != 0 || offset_zero)
+            {
+                value += data_offset & 0x7FFFFFFFu;
+            }
+
+            buffer |= (value & destination_mask) << buffered;
+            buffered += destination_width;
+
+            if (buffered == 32u)
+            {
+                append_word(output, buffer);
+
+                buffer = 0;
+                buffered = 0;
+            }
+        }
+    }
+
+    return output;
+}
+
+std::vector<uint8_t> bios_lz77_uncomp(const MMU &mmu, const uint32_t address)
+{
+    uint32_t source = address & 0xFFFFFFFCu;
+    uint32_t size = mmu.read32(source) >> 8u;
+
+    if ((source & 0xE000000u) == 0)
+    {
+        return {};
+    }
+
+    std::vector<uint8_t> output;
+
+    output.reserve(size);
+    source += 4u;
+
+    while (output.size() < size)
+    {
+        uint8_t flags = mmu.read8(source++);
+
+        for (uint32_t block = 0; block < 8u && output.size() < size; block++, flags <<= 1u)
+        {
+            if ((flags & 0x80u) == 0)
+            {
+                output.push_back(mmu.read8(source++));
+                continue;
+            }
+
+            uint8_t high = mmu.read8(source);
+            uint8_t low  = mmu.read8(source + 1u);
+            uint32_t length = (high >> 4u) + 3u;
+            uint32_t displacement = (((high & 0xFu) << 8u) | low) + 1u;
+
+            source += 2u;
+
+            for (; length > 0 && output.size() < size; --length)
+            {
+                // The BIOS would read whatever is in front of the destination, 0 is substituted here instead
+                uint8_t data = (displacement <= output.size()) ? output[output.size() - displacement] : 0;
+
+                output.push_back(data);
+            }
+        }
+    }
+
+    return output;
+}
+
+std::vector<uint8_t> bios_huff_uncomp(const MMU &mmu, const uint32_t address)
+{
+    uint32_t source = address & 0xFFFFFFFCu;
+    uint32_t header = mmu.read32(source);
+    uint32_t size = header >> 8u;
+    uint32_t data_width = header & 0xFu;
+
+    if ((source & 0xE000000u) == 0 || (data_width != 4u && data_width != 8u))
+    {
+        return {};
+    }
+
+    // The tree size byte is followed by the root node, the bit stream starts after the tree
+    uint32_t root = source + 5u;
+    uint32_t stream = source + 4u + ((mmu.read8(source + 4u) + 1u) << 1u);
+    uint32_t node_address = root;
+    uint8_t node = mmu.read8(root);
+    std::vector<uint8_t> output;
+    uint32_t buffer = 0;
+    uint32_t buffered = 0;
+
+    output.reserve(size + 3u);
+
+    while (output.size() < size)
+    {
+        uint32_t bits = mmu.read32(stream);
+
+        stream += 4u;
+
+        for (uint32_t bit = 0; bit < 32u && output.size() < size; bit++, bits <<= 1u)
+        {
+            uint32_t direction = bits >> 31u;
+            bool leaf = (node & (0x80u >> direction)) != 0;
+
+            node_address = (node_address & 0xFFFFFFFEu) + ((node & 0x3Fu) << 1u) + 2u + direction;
+            node = mmu.read8(node_address);
+
+            if (!leaf)
+            {
+                continue;
+            }
+
+            buffer |= (node & ((1u << data_width) - 1u)) << buffered;
+            buffered += data_width;
+
+            if (buffered == 32u)
+            {
+                append_word(output, buffer);
+
+                buffer = 0;
+                buffered = 0;
+            }
+
+            node_address = root;
+            node = mmu.read8(root);
+        }
+    }
+
+    return output;
+}
+
+std::vector<uint8_t> bios_rl_uncomp(const MMU &mmu, const uint32_t address)
+{
+    uint32_t source = address & 0xFFFFFFFCu;
+    uint32_t size = mmu.read32(source) >> 8u;
+
+    if ((source & 0xE000000u) == 0)
+    {
+        return {};
+    }
+
+    std::vector<uint8_t> output;
+
+    output.reserve(size);
+    source += 4u;
+
+    while (output.size() < size)
+    {
+        uint8_t flag = mmu.read8(source++);
+
+        if ((flag & 0x80u) != 0)
+        {
+            uint8_t data = mmu.read8(source++);
+
+            output.insert(output.end(), std::min<size_t>((flag & 0x7Fu) + 3u, size - output.size()), data);
+        }
+        else
+        {
+            for (uint32_t length = (flag & 0x7Fu) + 1u; length > 0 && output.size() < size; --length)
+            {
+                output.push_back(mmu.read8(source++));
+            }
+        }
+    }
+
+    return output;
+}
+
+std::vector<uint8_t> bios_diff_unfilter(const MMU &mmu, const uint32_t address, const bool wide)
+{
+    uint32_t source = address & 0xFFFFFFFCu;
+    uint32_t size = mmu.read32(source) >> 8u;
+
+    if ((source & 0xE000000u) == 0)
+    {
+        return {};
+    }
+
+    std::vector<uint8_t> output(size);
+    uint16_t value = 0;
+
+    source += 4u;
+
+    for (uint32_t i = 0; i < size; i += (wide) ? 2u : 1u)
+    {
+        if (wide)
+        {
+            value += mmu.read16(source + i);
+
+            output[i] = value;
+
+            if (i + 1u < size)
+            {
+                output[i + 1u] = value >> 8u;
+            }
+        }
+        else
+        {
+            value += mmu.read8(source + i);
+
+            output[i] = value;
+        }
+    }
+
+    return output;
+}
+
+void bios_write_output(MMU &mmu, const uint32_t destination, std::vector<uint8_t> &output, const uint32_t unit)
+{
+    output.resize((output.size() + unit - 1u) & ~(size_t)(unit - 1u), 0);
+
+    mmu.write_block(destination, output.data(), output.size(), unit);
+}
@@ -0,0 +1,42 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_HLE_DECOMPRESS_H
+#define AMAZINGLY_ADVANCED_HLE_DECOMPRESS_H
+
+
+#include <cinttypes>
+#include <vector>
+
+class MMU;
+
+// Decoders behind the BIOS decompression SWIs 0x10-0x18. They read the compressed stream through the MMU and
+// return the decoded bytes, nothing if the BIOS would reject the source
+[[nodiscard]] std::vector<uint8_t> bios_bit_unpack(const MMU &mmu, uint32_t source, uint32_t info);
+[[nodiscard]] std::vector<uint8_t> bios_lz77_uncomp(const MMU &mmu, uint32_t address);
+[[nodiscard]] std::vector<uint8_t> bios_huff_uncomp(const MMU &mmu, uint32_t address);
+[[nodiscard]] std::vector<uint8_t> bios_rl_uncomp(const MMU &mmu, uint32_t address);
+[[nodiscard]] std::vector<uint8_t> bios_diff_unfilter(const MMU &mmu, uint32_t address, bool wide);
+
+// Stores decoded data with the width the BIOS writes it with. The VRAM variants only write halfwords,
+// an odd last byte is padded with zero
+void bios_write_output(MMU &mmu, uint32_t destination, std::vector<uint8_t> &output, uint32_t unit);
+
+
+#endif //AMAZINGLY_ADVANCED_HLE_DECOMPRESS_H
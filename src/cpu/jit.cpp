@@ -0,0 +1,623 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#include "jit.h"
+
+#include "cpu.h"
+
+#include "../mmu/mmu.h"
+#include "../scheduler/scheduler.h"
+#include "../utils/profiler.h"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define AMAZINGLY_ADVANCED_JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Host registers, only the low 32 bits are used for guest values
+#define RAX 0u
+#define RCX 1u
+#define RDX 2u
+
+// x86 opcodes for "op r/m32, r32" and the shift group
+#define OP_ADD 0x01u
+#define OP_OR  0x09u
+#define OP_AND 0x21u
+#define OP_SUB 0x29u
+#define OP_XOR 0x31u
+#define OP_MOV 0x89u
+
+#define SHIFT_ROR 1u
+#define SHIFT_SHL 4u
+#define SHIFT_SHR 5u
+#define SHIFT_SAR 7u
+
+// Condition codes for Jcc
+#define COND_AE 0x3u
+#define COND_E  0x4u
+
+static constexpr size_t CODE_BUFFER_SIZE = 32u * 1024u * 1024u;
+
+static_assert(sizeof(FLAGS_CV) == 4, "FLAGS_CV is stored with 32-bit moves");
+
+static constexpr uint32_t get_register_offset(const uint8_t guest)
+{
+    return offsetof(CPU_Registers, r) + guest * sizeof(uint32_t);
+}
+
+static constexpr uint32_t get_flags_offset(const size_t field)
+{
+    return offsetof(CPU_Registers, flags) + field;
+}
+
+JIT::JIT(CPU *cpu) : cpu(cpu), code_buffer(nullptr), code_used(0), page_size(0), checked(false), code(), exit_jumps()
+{
+#ifdef AMAZINGLY_ADVANCED_JIT_SUPPORTED
+    void *buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (buffer == MAP_FAILED)
+    {
+        throw std::runtime_error("Couldn't allocate the JIT code buffer!");
+    }
+
+    code_buffer = (uint8_t *)buffer;
+    page_size = sysconf(_SC_PAGESIZE);
+#endif
+}
+
+JIT::~JIT()
+{
+#ifdef AMAZINGLY_ADVANCED_JIT_SUPPORTED
+    if (code_buffer != nullptr)
+    {
+        munmap(code_buffer, CODE_BUFFER_SIZE);
+    }
+#endif
+}
+
+bool JIT::is_supported()
+{
+#ifdef AMAZINGLY_ADVANCED_JIT_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JIT::set_checked(const bool enabled)
+{
+    checked = enabled;
+}
+
+void JIT::flush()
+{
+    code_used = 0;
+}
+
+// Switches the pages holding [start, start + size) between writable and executable
+void JIT::protect_code(const size_t start, const size_t size, const bool writable)
+{
+#ifdef AMAZINGLY_ADVANCED_JIT_SUPPORTED
+    size_t first = start & ~(page_size - 1u);
+    size_t last  = (start + size + page_size - 1u) & ~(page_size - 1u);
+
+    if (mprotect(code_buffer + first, last - first, (writable) ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0)
+    {
+        throw std::runtime_error("Couldn't change the protection of the JIT code buffer!");
+    }
+#endif
+}
+
+void JIT::emit8(const uint8_t value)
+{
+    code.push_back(value);
+}
+
+void JIT::emit32(const uint32_t value)
+{
+    for (uint32_t byte = 0; byte < 4; byte++)
+    {
+        code.push_back(value >> (byte * 8u));
+    }
+}
+
+void JIT::emit64(const uint64_t value)
+{
+    emit32(value);
+    emit32(value >> 32u);
+}
+
+// opcode reg, [rbx + offset]
+void JIT::emit_rbx_operand(const uint8_t opcode, const uint8_t reg, const uint32_t offset)
+{
+    emit8(opcode);
+    emit8(0x80u | (reg << 3u) | 3u);
+    emit32(offset);
+}
+
+void JIT::emit_load_register(const uint8_t host, const uint8_t guest)
+{
+    emit_rbx_operand(0x8Bu, host, get_register_offset(guest));
+}
+
+void JIT::emit_store_register(const uint8_t host, const uint8_t guest)
+{
+    emit_rbx_operand(OP_MOV, host, get_register_offset(guest));
+}
+
+void JIT::emit_mov_imm(const uint8_t host, const uint32_t value)
+{
+    emit8(0xB8u + host);
+    emit32(value);
+}
+
+void JIT::emit_mov_imm64(const uint8_t host, const uint64_t value)
+{
+    emit8(0x48u | ((host >> 3u) & 1u));
+    emit8(0xB8u + (host & 7u));
+    emit64(value);
+}
+
+void JIT::emit_alu(const uint8_t opcode, const uint8_t dst, const uint8_t src)
+{
+    emit8(opcode);
+    emit8(0xC0u | (src << 3u) | dst);
+}
+
+void JIT::emit_shift(const uint8_t op, const uint8_t host, const uint8_t amount)
+{
+    emit8(0xC1u);
+    emit8(0xC0u | (op << 3u) | host);
+    emit8(amount);
+}
+
+void JIT::emit_not(const uint8_t host)
+{
+    emit8(0xF7u);
+    emit8(0xD0u | host);
+}
+
+// The stack stays 16-byte aligned since rbx is the only thing pushed
+void JIT::emit_call(const uint64_t function)
+{
+    emit_mov_imm64(RAX, function);
+
+    // call rax
+    emit8(0xFFu);
+    emit8(0xD0u);
+}
+
+void JIT::emit_exit_jump(const uint8_t condition)
+{
+    emit8(0x0Fu);
+    emit8(0x80u | condition);
+
+    exit_jumps.push_back(code.size());
+    emit32(0);
+}
+
+// Result in eax
+void JIT::emit_set_nz()
+{
+    emit_rbx_operand(OP_MOV, RAX, get_flags_offset(offsetof(Lazy_Flags, n)));
+    emit_rbx_operand(OP_MOV, RAX, get_flags_offset(offsetof(Lazy_Flags, z)));
+}
+
+// Result in eax, operands in edx and ecx
+void JIT::emit_set_nzcv(const FLAGS_CV cv)
+{
+    emit_set_nz();
+
+    // mov dword [rbx + offset], cv
+    emit8(0xC7u);
+    emit8(0x83u);
+    emit32(get_flags_offset(offsetof(Lazy_Flags, cv)));
+    emit32(cv);
+
+    emit_rbx_operand(OP_MOV, RDX, get_flags_offset(offsetof(Lazy_Flags, a)));
+    emit_rbx_operand(OP_MOV, RCX, get_flags_offset(offsetof(Lazy_Flags, b)));
+    emit_rbx_operand(OP_MOV, RAX, get_flags_offset(offsetof(Lazy_Flags, result)));
+}
+
+// Advances pc and adds the sequential fetch, which is read at run time since WAITCNT may change
+void JIT::emit_instruction_start(const uint32_t address, const bool thumb)
+{
+    size_t region = (address >> 24u) & 0xFu;
+    const uint8_t *fetch_cycles = (thumb) ? &cpu->mmu->cycles_s16[region] : &cpu->mmu->cycles_s32[region];
+
+    if (checked)
+    {
+        emit_mov_imm64(7u, (uint64_t)cpu);
+        emit_call((uint64_t)&CPU::jit_save_state);
+    }
+
+#ifdef AMAZINGLY_ADVANCED_PROFILE
+    // add qword [rax], 1
+    emit_mov_imm64(RAX, (uint64_t)&profile_counters.instructions);
+    emit8(0x48u);
+    emit8(0x83u);
+    emit8(0x00u);
+    emit8(0x01u);
+#endif
+
+    // add dword [rbx + pc], width
+    emit8(0x83u);
+    emit8(0x83u);
+    emit32(offsetof(CPU_Registers, pc));
+    emit8((thumb) ? 2u : 4u);
+
+    // movzx eax, byte [rax]
+    emit_mov_imm64(RAX, (uint64_t)fetch_cycles);
+    emit8(0x0Fu);
+    emit8(0xB6u);
+    emit8(0x00u);
+
+    // add [rdx], rax
+    emit_mov_imm64(RDX, (uint64_t)&cpu->scheduler->timestamp);
+    emit8(0x48u);
+    emit8(0x01u);
+    emit8(0x02u);
+}
+
+// Inline instructions can't branch, switch state or raise interrupts, only the next event can end the block
+void JIT::emit_instruction_end(const Decoded_Instruction &decoded, const bool thumb)
+{
+    if (checked)
+    {
+        emit_mov_imm64(7u, (uint64_t)cpu);
+        emit_mov_imm64(6u, (uint64_t)&decoded);
+        emit_mov_imm(RDX, thumb);
+        emit_call((uint64_t)&CPU::jit_check_instruction);
+
+        // test al, al
+        emit8(0x84u);
+        emit8(0xC0u);
+        emit_exit_jump(COND_E);
+    }
+
+    // cmp [timestamp], [next_event]
+    emit_mov_imm64(RDX, (uint64_t)&cpu->scheduler->timestamp);
+    emit_mov_imm64(RCX, (uint64_t)&cpu->scheduler->next_event);
+    emit8(0x48u);
+    emit8(0x8Bu);
+    emit8(0x02u);
+    emit8(0x48u);
+    emit8(0x3Bu);
+    emit8(0x01u);
+    emit_exit_jump(COND_AE);
+}
+
+void JIT::emit_fallback(const Decoded_Instruction &decoded, const uint32_t next_address, const bool thumb)
+{
+    emit_mov_imm64(7u, (uint64_t)cpu);
+    emit_mov_imm64(6u, (uint64_t)&decoded);
+    emit_mov_imm(RDX, next_address);
+    emit_mov_imm(RCX, thumb);
+    emit_call((uint64_t)&CPU::jit_run_instruction);
+
+    // test al, al
+    emit8(0x84u);
+    emit8(0xC0u);
+    emit_exit_jump(COND_E);
+}
+
+// AL data processing without S, r15 and register-specified shifts
+bool JIT::emit_arm(const uint32_t instruction, const uint32_t address)
+{
+    bool imm_op  = ((instruction >> 25u) & 1u) != 0;
+    uint32_t op  = (instruction >> 21u) & 0xFu;
+    uint8_t rn   = (instruction >> 16u) & 0xFu;
+    uint8_t rd   = (instruction >> 12u) & 0xFu;
+    uint8_t rm   = instruction & 0xFu;
+    uint8_t mode = (instruction >> 5u) & 3u;
+    uint8_t amount = (instruction >> 7u) & 0x1Fu;
+    bool uses_rn = op != 0b1101 && op != 0b1111;
+
+    if ((instruction >> 28u) != 0b1110 || ((instruction >> 26u) & 3u) != 0 || ((instruction >> 20u) & 1u) != 0)
+    {
+        return false;
+    }
+
+    // ADC, SBC and RSC read the carry, the rest without S are MRS and MSR
+    if ((op >= 0b0101 && op <= 0b1011) || rd == 15 || (uses_rn && rn == 15))
+    {
+        return false;
+    }
+
+    // RRX reads the carry as well
+    if (!imm_op && (((instruction >> 4u) & 1u) != 0 || rm == 15 || (mode == 0b11 && amount == 0)))
+    {
+        return false;
+    }
+
+    emit_instruction_start(address, false);
+
+    if (imm_op)
+    {
+        uint32_t imm = instruction & 0xFFu;
+        uint32_t rotate = ((instruction >> 8u) & 0xFu) << 1u;
+
+        emit_mov_imm(RCX, (rotate == 0) ? imm : (imm >> rotate) | (imm << (32u - rotate)));
+    }
+    else
+    {
+        emit_load_register(RCX, rm);
+
+        // LSR #0 and ASR #0 encode shifts by 32
+        switch (mode)
+        {
+            case 0b00:
+                if (amount != 0)
+                {
+                    emit_shift(SHIFT_SHL, RCX, amount);
+                }
+                break;
+            case 0b01:
+                if (amount != 0)
+                {
+                    emit_shift(SHIFT_SHR, RCX, amount);
+                }
+                else
+                {
+                    emit_mov_imm(RCX, 0);
+                }
+                break;
+            case 0b10:
+                emit_shift(SHIFT_SAR, RCX, (amount != 0) ? amount : 31u);
+                break;
+            default:
+                emit_shift(SHIFT_ROR, RCX, amount);
+                break;
+        }
+    }
+
+    if (uses_rn)
+    {
+        emit_load_register(RAX, rn);
+    }
+
+    switch (op)
+    {
+        case 0b0000: emit_alu(OP_AND, RAX, RCX); break;
+        case 0b0001: emit_alu(OP_XOR, RAX, RCX); break;
+        case 0b0010: emit_alu(OP_SUB, RAX, RCX); break;
+        case 0b0011:
+            emit_alu(OP_SUB, RCX, RAX);
+            emit_alu(OP_MOV, RAX, RCX);
+            break;
+        case 0b0100: emit_alu(OP_ADD, RAX, RCX); break;
+        case 0b1100: emit_alu(OP_OR, RAX, RCX); break;
+        case 0b1101: emit_alu(OP_MOV, RAX, RCX); break;
+        case 0b1110:
+            emit_not(RCX);
+            emit_alu(OP_AND, RAX, RCX);
+            break;
+        default:
+            emit_not(RCX);
+            emit_alu(OP_MOV, RAX, RCX);
+            break;
+    }
+
+    emit_store_register(RAX, rd);
+
+    return true;
+}
+
+// Add/subtract, move/compare/add/subtract immediate, hi register ADD and MOV, load address and add offset to SP
+bool JIT::emit_thumb(const uint16_t instruction, const uint32_t address)
+{
+    if ((instruction & 0xF800u) == 0x1800u)
+    {
+        bool imm = ((instruction >> 10u) & 1u) != 0;
+        bool sub = ((instruction >> 9u) & 1u) != 0;
+        uint8_t field = (instruction >> 6u) & 7u;
+        uint8_t rs = (instruction >> 3u) & 7u;
+        uint8_t rd = instruction & 7u;
+
+        emit_instruction_start(address, true);
+
+        emit_load_register(RDX, rs);
+
+        if (imm)
+        {
+            emit_mov_imm(RCX, field);
+        }
+        else
+        {
+            emit_load_register(RCX, field);
+        }
+
+        emit_alu(OP_MOV, RAX, RDX);
+        emit_alu((sub) ? OP_SUB : OP_ADD, RAX, RCX);
+        emit_store_register(RAX, rd);
+        emit_set_nzcv((sub) ? FLAGS_CV::Flags_Sub : FLAGS_CV::Flags_Add);
+
+        return true;
+    }
+
+    if ((instruction & 0xE000u) == 0x2000u)
+    {
+        uint32_t op = (instruction >> 11u) & 3u;
+        uint8_t rd  = (instruction >> 8u) & 7u;
+        uint8_t offset8 = instruction & 0xFFu;
+
+        emit_instruction_start(address, true);
+
+        if (op == 0b00)
+        {
+            emit_mov_imm(RAX, offset8);
+            emit_store_register(RAX, rd);
+            emit_set_nz();
+
+            return true;
+        }
+
+        emit_load_register(RDX, rd);
+        emit_mov_imm(RCX, offset8);
+        emit_alu(OP_MOV, RAX, RDX);
+        emit_alu((op == 0b10) ? OP_ADD : OP_SUB, RAX, RCX);
+
+        if (op != 0b01)
+        {
+            emit_store_register(RAX, rd);
+        }
+
+        emit_set_nzcv((op == 0b10) ? FLAGS_CV::Flags_Add : FLAGS_CV::Flags_Sub);
+
+        return true;
+    }
+
+    if ((instruction & 0xFC00u) == 0x4400u)
+    {
+        uint32_t op = (instruction >> 8u) & 3u;
+        uint8_t rs  = (instruction >> 3u) & 0xFu;
+        uint8_t rd  = (instruction & 7u) | ((instruction >> 4u) & 8u);
+
+        // CMP sets flags, BX branches
+        if ((op != 0b00 && op != 0b10) || rs == 15 || rd == 15)
+        {
+            return false;
+        }
+
+        emit_instruction_start(address, true);
+
+        emit_load_register(RAX, rs);
+
+        if (op == 0b00)
+        {
+            emit_load_register(RCX, rd);
+            emit_alu(OP_ADD, RAX, RCX);
+        }
+
+        emit_store_register(RAX, rd);
+
+        return true;
+    }
+
+    if ((instruction & 0xF000u) == 0xA000u)
+    {
+        bool sp = ((instruction >> 11u) & 1u) != 0;
+        uint8_t rd = (instruction >> 8u) & 7u;
+        uint32_t word8 = (instruction & 0xFFu) << 2u;
+
+        emit_instruction_start(address, true);
+
+        if (sp)
+        {
+            emit_load_register(RAX, 13);
+            emit_mov_imm(RCX, word8);
+            emit_alu(OP_ADD, RAX, RCX);
+        }
+        else
+        {
+            // pc is known when compiling
+            emit_mov_imm(RAX, ((address + 4u) & 0xFFFFFFFCu) + word8);
+        }
+
+        emit_store_register(RAX, rd);
+
+        return true;
+    }
+
+    if ((instruction & 0xFF00u) == 0xB000u)
+    {
+        bool negative = ((instruction >> 7u) & 1u) != 0;
+        uint32_t sword8 = (instruction & 0x7Fu) << 2u;
+
+        emit_instruction_start(address, true);
+
+        emit_load_register(RAX, 13);
+        emit_mov_imm(RCX, sword8);
+        emit_alu((negative) ? OP_SUB : OP_ADD, RAX, RCX);
+        emit_store_register(RAX, 13);
+
+        return true;
+    }
+
+    return false;
+}
+
+// Blocks are compiled as a whole when they're first run. Instructions that aren't emitted inline go through
+// CPU::jit_run_instruction, which also decides whether the block goes on, the exit returns to CPU::run
+Native_Code JIT::compile(const Block &block)
+{
+    uint32_t width = (block.thumb) ? 2u : 4u;
+    size_t size = block.instructions.size();
+
+    code.clear();
+    exit_jumps.clear();
+
+    // push rbx, mov rbx, &regs
+    emit8(0x53u);
+    emit_mov_imm64(3u, (uint64_t)&cpu->regs);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        const Decoded_Instruction &decoded = block.instructions[i];
+        uint32_t address = block.address + i * width;
+        size_t next = i + ((decoded.fused) ? 2u : 1u);
+
+        bool native = !decoded.fused && ((block.thumb) ? emit_thumb((uint16_t)decoded.instruction, address)
+                                                       : emit_arm(decoded.instruction, address));
+
+        if (native)
+        {
+            emit_instruction_end(decoded, block.thumb);
+        }
+        else
+        {
+            emit_fallback(decoded, block.address + next * width, block.thumb);
+        }
+
+        i = next - 1u;
+    }
+
+    for (size_t jump : exit_jumps)
+    {
+        uint32_t offset = code.size() - (jump + 4u);
+
+        std::memcpy(&code[jump], &offset, sizeof(offset));
+    }
+
+    // pop rbx, ret
+    emit8(0x5Bu);
+    emit8(0xC3u);
+
+    // Blocks start on 16-byte boundaries
+    size_t start = (code_used + 15u) & ~(size_t)15u;
+
+    if (code_buffer == nullptr || start + code.size() > CODE_BUFFER_SIZE)
+    {
+        return nullptr;
+    }
+
+    protect_code(start, code.size(), true);
+
+    std::memcpy(code_buffer + start, code.data(), code.size());
+
+    protect_code(start, code.size(), false);
+
+    code_used = start + code.size();
+
+    return (Native_Code)(code_buffer + start);
+}
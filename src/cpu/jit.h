@@ -0,0 +1,92 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_JIT_H
+#define AMAZINGLY_ADVANCED_JIT_H
+
+
+#include "cpu_blocks.h"
+#include "cpu_registers.h"
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+// Translates decoded blocks to x86-64 code. Data processing instructions that can't write r15 or set flags
+// in a mode-dependent way are emitted inline, every other instruction calls back into the interpreter.
+// Guest registers stay in CPU_Registers, rbx points to them while a block runs
+class JIT
+{
+private:
+    CPU *cpu;
+
+    // Buffer shared by all blocks, code is only appended until the next flush. Pages are never writable and
+    // executable at the same time, they're made writable only while a block is copied into them
+    uint8_t *code_buffer;
+    size_t code_used;
+    size_t page_size;
+
+    // Compare every inline instruction with the interpreter
+    bool checked;
+
+    // Code of the block being compiled and the positions of its jumps to the block exit
+    std::vector<uint8_t> code;
+    std::vector<size_t> exit_jumps;
+
+    inline void emit8(uint8_t value);
+    inline void emit32(uint32_t value);
+    inline void emit64(uint64_t value);
+    inline void emit_rbx_operand(uint8_t opcode, uint8_t reg, uint32_t offset);
+    inline void emit_load_register(uint8_t host, uint8_t guest);
+    inline void emit_store_register(uint8_t host, uint8_t guest);
+    inline void emit_mov_imm(uint8_t host, uint32_t value);
+    inline void emit_mov_imm64(uint8_t host, uint64_t value);
+    inline void emit_alu(uint8_t opcode, uint8_t dst, uint8_t src);
+    inline void emit_shift(uint8_t op, uint8_t host, uint8_t amount);
+    inline void emit_not(uint8_t host);
+    inline void emit_call(uint64_t function);
+    inline void emit_exit_jump(uint8_t condition);
+
+    inline void emit_set_nz();
+    inline void emit_set_nzcv(FLAGS_CV cv);
+    inline void emit_instruction_start(uint32_t address, bool thumb);
+    inline void emit_instruction_end(const Decoded_Instruction &decoded, bool thumb);
+    inline void emit_fallback(const Decoded_Instruction &decoded, uint32_t next_address, bool thumb);
+
+    inline void protect_code(size_t start, size_t size, bool writable);
+
+    [[nodiscard]] inline bool emit_arm(uint32_t instruction, uint32_t address);
+    [[nodiscard]] inline bool emit_thumb(uint16_t instruction, uint32_t address);
+public:
+    explicit JIT(CPU *cpu);
+    ~JIT();
+
+    [[nodiscard]] static bool is_supported();
+
+    void set_checked(bool enabled);
+
+    // Drops all compiled code, blocks still pointing into the buffer must not be run afterwards
+    void flush();
+
+    // Returns nullptr if the code buffer is full
+    [[nodiscard]] Native_Code compile(const Block &block);
+};
+
+
+#endif //AMAZINGLY_ADVANCED_JIT_H
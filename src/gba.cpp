@@ -21,16 +21,45 @@
 #include "cpu/cpu.h"
 #include "lcd/lcd.h"
 #include "mmu/mmu.h"
+#include "mmu/cartridge/cartridge.h"
 #include "mmu/dma/dma.h"
+#include "scheduler/scheduler.h"
 #include "timer/timer.h"
+#include "utils/file_utils.h"
+#include "utils/profiler.h"
 
-GBA::GBA(const char *const bios_path, const char *const rom_path) :
-renderer(nullptr), window(nullptr), texture(nullptr), event(), is_running(true)
+#include <charconv>
+#include <sstream>
+#include <string>
+
+constexpr uint64_t hash_frame(const uint8_t *const framebuffer, const size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325u;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ framebuffer[i]) * 0x100000001B3u;
+    }
+
+    return hash;
+}
+
+GBA::GBA(const char *const bios_path, const char *const rom_path, const bool headless) :
+renderer(nullptr), window(nullptr), texture(nullptr), event(), is_running(true), headless(headless),
+predecode(true), frame_count(0), frame_limit(0), cycle_limit(0), frame_hashes()
 {
     mmu = std::make_shared<MMU>(bios_path, rom_path, this);
     cpu = std::make_unique<CPU>(mmu);
 
-    init_sdl();
+    if (bios_path == nullptr)
+    {
+        cpu->set_hle_swi(true);
+    }
+
+    if (!headless)
+    {
+        init_sdl();
+    }
 }
 
 GBA::~GBA()
@@ -50,8 +79,154 @@ void GBA::init_sdl()
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB555, SDL_TEXTUREACCESS_STREAMING, 240, 160);
 }
 
+void GBA::set_cpu_engine(const CPU_ENGINE engine)
+{
+    cpu->set_engine(engine);
+}
+
+void GBA::set_render_mode(const RENDER_MODE mode)
+{
+    mmu->lcd->set_render_mode(mode);
+}
+
+void GBA::set_idle_skip(const bool enabled)
+{
+    cpu->set_idle_skip(enabled);
+}
+
+void GBA::set_hle_swi(const bool enabled)
+{
+    cpu->set_hle_swi(enabled);
+}
+
+void GBA::set_predecode(const bool enabled)
+{
+    predecode = enabled;
+}
+
+void GBA::load_idle_loops(const char *const path)
+{
+    std::ifstream file(path);
+
+    if (!file.is_open())
+    {
+        spdlog::get("AmazinglyAdvanced")->error("Couldn't open file {}!", path);
+
+        throw std::runtime_error("Error opening idle loop table!");
+    }
+
+    const std::vector<uint8_t> &rom = mmu->cart->data;
+    std::string game_code = (rom.size() >= 0xB0) ? std::string(rom.begin() + 0xAC, rom.begin() + 0xB0) : "";
+    std::string line;
+    size_t line_number = 0;
+
+    while (std::getline(file, line))
+    {
+        std::istringstream entry(line);
+        std::string code;
+        std::string token;
+
+        ++line_number;
+
+        if (line.empty() || line[0] == '#' || !(entry >> code >> token) || code != game_code)
+        {
+            continue;
+        }
+
+        const char *first = token.data();
+        const char *last  = token.data() + token.size();
+        uint32_t address  = 0;
+
+        if (token.size() > 2 && token[0] == '0' && (token[1] == 'x' || token[1] == 'X'))
+        {
+            first += 2;
+        }
+
+        auto [end, error] = std::from_chars(first, last, address, 16);
+
+        if (error != std::errc() || end != last)
+        {
+            spdlog::get("AmazinglyAdvanced")->warn("{}:{}: invalid idle loop address \"{}\", skipping", path, line_number,
+                                                   token);
+            continue;
+        }
+
+        // Only code in WRAM and the Game Pak ROM can be an idle loop block
+        if (!(address >= 0x02000000 && address < 0x02040000) && !(address >= 0x03000000 && address < 0x03008000) &&
+            !(address >= 0x08000000 && address < 0x0E000000))
+        {
+            spdlog::get("AmazinglyAdvanced")->warn("{}:{}: idle loop address {:08X}h is outside WRAM and ROM, skipping",
+                                                   path, line_number, address);
+            continue;
+        }
+
+        cpu->add_idle_loop(address);
+    }
+}
+
+void GBA::set_frame_limit(const uint64_t frames)
+{
+    frame_limit = frames;
+}
+
+void GBA::set_cycle_limit(const uint64_t cycles)
+{
+    cycle_limit = cycles;
+}
+
+uint64_t GBA::get_frame_count() const
+{
+    return frame_count;
+}
+
+uint64_t GBA::get_cycles() const
+{
+    return mmu->scheduler->get_timestamp();
+}
+
+void GBA::set_frame_hash_path(const char *const path)
+{
+    frame_hashes.open(path);
+
+    if (!frame_hashes.is_open())
+    {
+        spdlog::get("AmazinglyAdvanced")->error("Couldn't open file {}!", path);
+
+        throw std::runtime_error("Error opening frame hash file!");
+    }
+}
+
+void GBA::dump_framebuffer(const char *const path)
+{
+    const uint8_t *framebuffer = mmu->lcd->get_framebuffer();
+    std::string header = "P6\n240 160\n255\n";
+    std::vector<uint8_t> image(header.begin(), header.end());
+
+    image.reserve(header.size() + 240 * 160 * 3);
+
+    for (size_t pixel = 0; pixel < 240 * 160; pixel++)
+    {
+        uint16_t color = *(const uint16_t*)(framebuffer + (pixel * 2u));
+
+        // RGB555, expand each channel to 8 bits
+        for (uint32_t shift : { 10u, 5u, 0u })
+        {
+            uint8_t channel = (color >> shift) & 0x1Fu;
+
+            image.push_back((channel << 3u) | (channel >> 2u));
+        }
+    }
+
+    save_file(path, image);
+}
+
 uint16_t GBA::get_input()
 {
+    if (headless)
+    {
+        return 0xFFFF;
+    }
+
     const uint8_t *keyboard_state = SDL_GetKeyboardState(nullptr);
     uint16_t input = 0;
 
@@ -106,39 +281,89 @@ uint16_t GBA::get_input()
 
 void GBA::draw_framebuffer(const uint8_t *framebuffer)
 {
-    SDL_UpdateTexture(texture, nullptr, framebuffer, 240 * sizeof(uint8_t) * 2);
-    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-    SDL_RenderPresent(renderer);
+    ++frame_count;
+
+    if (frame_hashes.is_open())
+    {
+        frame_hashes << fmt::format("{} {:016X}\n", frame_count, hash_frame(framebuffer, 240 * 160 * 2));
+    }
+
+    if (!headless)
+    {
+        SDL_UpdateTexture(texture, nullptr, framebuffer, 240 * sizeof(uint8_t) * 2);
+        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+    }
+
+    if ((frame_limit != 0) && (frame_count >= frame_limit))
+    {
+        is_running = false;
+    }
 }
 
 void GBA::run()
 {
+    if (predecode)
+    {
+        cpu->start_predecode();
+    }
+
     while (is_running)
     {
         try
         {
-            if (mmu->dma->is_enabled())
             {
-                mmu->dma->check_start_cond();
+                PROFILE_SCOPE(Profile_CPU);
+
+                cpu->run();
             }
 
-            if (mmu->dma->is_running())
+            while (mmu->scheduler->is_event_due())
             {
-                mmu->dma->run();
-                mmu->dma->run();
+                Event event = mmu->scheduler->pop_event();
+
+                switch (event.type)
+                {
+                    case LCD_HBlank:
+                    {
+                        PROFILE_SCOPE(Profile_LCD);
+
+                        mmu->lcd->hblank(event.timestamp);
+                        break;
+                    }
+                    case LCD_HDraw:
+                    {
+                        PROFILE_SCOPE(Profile_LCD);
+
+                        mmu->lcd->hdraw(event.timestamp);
+                        break;
+                    }
+                    case Timer0_Overflow:
+                    case Timer1_Overflow:
+                    case Timer2_Overflow:
+                    case Timer3_Overflow:
+                    {
+                        PROFILE_SCOPE(Profile_Timer);
+
+                        mmu->timer->overflow(event.type - Timer0_Overflow, event.timestamp);
+                        break;
+                    }
+                    case DMA_Transfer:
+                    {
+                        PROFILE_SCOPE(Profile_DMA);
+
+                        mmu->dma->run();
+                        break;
+                    }
+                    default:
+                        break;
+                }
             }
-            else
+
+            if ((cycle_limit != 0) && (mmu->scheduler->get_timestamp() >= cycle_limit))
             {
-                cpu->run();
-                cpu->run();
+                is_running = false;
             }
-
-            mmu->timer->run();
-            mmu->timer->run();
-            mmu->timer->run();
-            mmu->timer->run();
-
-            mmu->lcd->run();
         }
         catch (const std::runtime_error &e)
         {
@@ -21,6 +21,10 @@
 #define AMAZINGLY_ADVANCED_GBA_H
 
 
+#include "cpu/cpu_blocks.h"
+#include "lcd/lcd_render.h"
+
+#include <fstream>
 #include <memory>
 
 #include <SDL2/SDL.h>
@@ -41,11 +45,47 @@ private:
 
     bool is_running;
 
+    // Headless runs create no window and aren't synced to the display
+    bool headless;
+
+    // ROM code is decoded on a background thread from the start of run()
+    bool predecode;
+
+    uint64_t frame_count;
+
+    // 0 means no limit
+    uint64_t frame_limit;
+    uint64_t cycle_limit;
+
+    std::ofstream frame_hashes;
+
     void init_sdl();
 public:
-    GBA(const char *bios_path, const char *rom_path);
+    // Without a BIOS path a stub BIOS is mapped and SWIs are always handled by the HLE layer
+    GBA(const char *bios_path, const char *rom_path, bool headless = false);
     ~GBA();
 
+    void set_cpu_engine(CPU_ENGINE engine);
+    void set_render_mode(RENDER_MODE mode);
+    void set_idle_skip(bool enabled);
+    void set_hle_swi(bool enabled);
+    void set_predecode(bool enabled);
+
+    // Reads a text file with one "<game code> <hex address>" idle loop per line, entries for other games are ignored
+    void load_idle_loops(const char *path);
+
+    void set_frame_limit(uint64_t frames);
+    void set_cycle_limit(uint64_t cycles);
+
+    [[nodiscard]] uint64_t get_frame_count() const;
+    [[nodiscard]] uint64_t get_cycles() const;
+
+    // Writes the frame number and an FNV-1a hash of every presented frame to a text file
+    void set_frame_hash_path(const char *path);
+
+    // Saves the current framebuffer as a binary PPM image
+    void dump_framebuffer(const char *path);
+
     uint16_t get_input();
 
     void draw_framebuffer(const uint8_t *framebuffer);
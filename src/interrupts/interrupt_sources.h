@@ -0,0 +1,38 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_INTERRUPT_SOURCES_H
+#define AMAZINGLY_ADVANCED_INTERRUPT_SOURCES_H
+
+
+// IE/IF bits, timer and DMA interrupts of the other channels follow their channel 0 bit
+enum INTERRUPT
+{
+    Interrupt_VBlank  = 0x0001,
+    Interrupt_HBlank  = 0x0002,
+    Interrupt_VCount  = 0x0004,
+    Interrupt_Timer0  = 0x0008,
+    Interrupt_Serial  = 0x0080,
+    Interrupt_DMA0    = 0x0100,
+    Interrupt_Keypad  = 0x1000,
+    Interrupt_GamePak = 0x2000
+};
+
+
+#endif //AMAZINGLY_ADVANCED_INTERRUPT_SOURCES_H
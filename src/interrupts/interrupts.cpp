@@ -0,0 +1,68 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#include "interrupts.h"
+
+Interrupts::Interrupts() :
+master_enable(0), enable(0), request_flags(0), irq_disable(false), irq_pending(false)
+{
+}
+
+Interrupts::~Interrupts()
+= default;
+
+void Interrupts::update_irq_pending()
+{
+    irq_pending = (master_enable & 1u) != 0 && !irq_disable && (enable & request_flags) != 0;
+}
+
+void Interrupts::set_master_enable(const uint16_t value)
+{
+    master_enable = value;
+
+    update_irq_pending();
+}
+
+void Interrupts::set_enable(const uint16_t value)
+{
+    enable = value;
+
+    update_irq_pending();
+}
+
+void Interrupts::set_irq_disable(const bool disabled)
+{
+    irq_disable = disabled;
+
+    update_irq_pending();
+}
+
+void Interrupts::request(const uint16_t flags)
+{
+    request_flags |= flags;
+
+    update_irq_pending();
+}
+
+// Writing 1 to an IF bit clears it
+void Interrupts::acknowledge(const uint16_t flags)
+{
+    request_flags &= (uint16_t)~flags;
+
+    update_irq_pending();
+}
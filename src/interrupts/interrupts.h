@@ -0,0 +1,62 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_INTERRUPTS_H
+#define AMAZINGLY_ADVANCED_INTERRUPTS_H
+
+
+#include "interrupt_sources.h"
+
+#include <cinttypes>
+
+// IE, IF and IME plus a copy of the CPSR I bit. The IRQ line is only recomputed when one of them changes,
+// so the CPU can check a single flag between instructions
+class Interrupts
+{
+private:
+    uint16_t master_enable;
+    uint16_t enable;
+    uint16_t request_flags;
+
+    bool irq_disable;
+    bool irq_pending;
+
+    void update_irq_pending();
+public:
+    Interrupts();
+    ~Interrupts();
+
+    [[nodiscard]] uint16_t get_master_enable() const { return master_enable; }
+    [[nodiscard]] uint16_t get_enable() const { return enable; }
+    [[nodiscard]] uint16_t get_request_flags() const { return request_flags; }
+
+    // Requested and enabled interrupts, whether or not IME and the I bit let them through
+    [[nodiscard]] uint16_t get_pending() const { return enable & request_flags; }
+    [[nodiscard]] bool is_irq_pending() const { return irq_pending; }
+
+    void set_master_enable(uint16_t value);
+    void set_enable(uint16_t value);
+    void set_irq_disable(bool disabled);
+
+    void request(uint16_t flags);
+    void acknowledge(uint16_t flags);
+};
+
+
+#endif //AMAZINGLY_ADVANCED_INTERRUPTS_H
@@ -20,11 +20,29 @@
 #include "lcd_registers.h"
 
 #include "../gba.h"
+#include "../interrupts/interrupts.h"
 #include "../mmu/mmu.h"
+#include "../mmu/dma/dma.h"
+#include "../scheduler/scheduler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 const uint32_t SET_SIZE = 0x4000;
+const uint32_t VRAM_CHUNK_SIZE = 0x400;
 const uint32_t MAP_SIZE = 0x800;
 
+const uint32_t HDRAW_CYCLES  = 960;
+const uint32_t HBLANK_CYCLES = 272;
+
+// Composition key of a transparent BG pixel, palette index 0 is the backdrop color
+const uint16_t TRANSPARENT_PIXEL = 0x7F00;
+
 const uint8_t map_width[]  = { 32, 64, 32, 64 };
 const uint8_t map_height[] = { 32, 32, 64, 64 };
 
@@ -48,14 +66,30 @@ constexpr uint32_t get_map_offset(const uint32_t x, const uint32_t y)
     return 0x800 * offset;
 }
 
+constexpr uint32_t get_vram_offset(const uint32_t offset)
+{
+    // The upper 32 KiB of the 128 KiB VRAM area mirror the OBJ tiles
+    return (offset >= 0x18000u) ? (offset - 0x8000u) : offset;
+}
+
 LCD::LCD(MMU *const mmu) :
-mmu(mmu), lcd_cycle(0), modes(), regs(), framebuffer(240 * 160 * 2, 0)
+mmu(mmu), bg_lines(), color_line(), line_regs(&regs), line_vram(mmu->vram.data()),
+line_palette_ram(mmu->palette_ram.data()), line_framebuffer(nullptr), modes(), render_mode(RENDER_MODE::Serial),
+front_buffer(0), back_buffer(0), render_queue(), render_vram(mmu->vram.size(), 0), render_running(false),
+render_failed(false), regs()
 {
+    for (auto &framebuffer : framebuffers)
+    {
+        framebuffer.assign(240 * 160 * 2, 0);
+    }
+
+    line_framebuffer = framebuffers[0].data();
+
     regs.control.forced_blank = true;
 
-    for (size_t i = 0; i < 5; i++)
+    for (auto &mode : modes)
     {
-        modes[i] = &LCD::unknown_mode;
+        mode = &LCD::unknown_mode;
     }
 
     modes[0] = &LCD::mode_0;
@@ -63,248 +97,434 @@ mmu(mmu), lcd_cycle(0), modes(), regs(), framebuffer(240 * 160 * 2, 0)
     modes[2] = &LCD::mode_0;
     modes[3] = &LCD::mode_3;
     modes[4] = &LCD::mode_4;
+
+    mmu->scheduler->add_event(EVENT_TYPE::LCD_HBlank, HDRAW_CYCLES);
 }
 
 LCD::~LCD()
-= default;
+{
+    stop_render_thread();
+}
+
+void LCD::set_render_mode(const RENDER_MODE mode)
+{
+    stop_render_thread();
+
+    render_mode = mode;
+
+    front_buffer.store(0);
+    back_buffer = (mode == RENDER_MODE::Threaded) ? 1 : 0;
+
+    if (mode == RENDER_MODE::Serial)
+    {
+        line_regs = &regs;
+        line_vram = mmu->vram.data();
+        line_palette_ram = mmu->palette_ram.data();
+        line_framebuffer = framebuffers[0].data();
+
+        mmu->set_vram_tracking(false);
+    }
+    else
+    {
+        // Every chunk is marked dirty, so the first job uploads all of VRAM to the render thread
+        mmu->set_vram_tracking(true);
+
+        render_running.store(true);
+        render_thread = std::thread(&LCD::run_render_thread, this);
+    }
+}
+
+const uint8_t *LCD::get_framebuffer()
+{
+    if (render_mode == RENDER_MODE::Deterministic)
+    {
+        wait_for_render_thread();
+    }
+
+    return framebuffers[front_buffer.load(std::memory_order_acquire)].data();
+}
 
-void LCD::tick()
+void LCD::submit_scanline()
 {
-    ++lcd_cycle;
+    Render_Job *job;
 
-    if (lcd_cycle == 240)
+    while ((job = render_queue.back()) == nullptr)
     {
-        regs.status.hblank = true;
+        check_render_thread();
 
-        if (regs.status.hblank_irq)
+        std::this_thread::yield();
+    }
+
+    job->regs = regs;
+
+    std::memcpy(job->palette_ram.data(), mmu->palette_ram.data(), job->palette_ram.size());
+
+    job->vram_chunks.clear();
+    job->vram_data.clear();
+
+    for (size_t chunk = 0; chunk < mmu->vram_dirty.size(); chunk++)
+    {
+        if (mmu->vram_dirty[chunk])
         {
-            mmu->interrupt_request_flags |= 2u;
+            const uint8_t *data = mmu->vram.data() + (chunk * VRAM_CHUNK_SIZE);
+
+            job->vram_chunks.push_back(chunk);
+            job->vram_data.insert(job->vram_data.end(), data, data + VRAM_CHUNK_SIZE);
         }
     }
-    else if (lcd_cycle == 308)
+
+    mmu->vram_dirty.reset();
+
+    render_queue.push();
+}
+
+void LCD::wait_for_render_thread()
+{
+    while (!render_queue.empty())
+    {
+        check_render_thread();
+
+        std::this_thread::yield();
+    }
+
+    check_render_thread();
+}
+
+void LCD::check_render_thread()
+{
+    if (render_failed.load(std::memory_order_acquire))
+    {
+        std::rethrow_exception(render_exception);
+    }
+}
+
+void LCD::run_render_thread()
+{
+    while (render_running.load(std::memory_order_acquire))
     {
-        ++regs.vcount;
-        lcd_cycle = 0;
+        Render_Job *job = render_queue.front();
 
-        if (regs.vcount == regs.status.vcount_setting)
+        if (job == nullptr)
         {
-            regs.status.vcount_coincidence = true;
+            std::this_thread::yield();
+            continue;
+        }
 
-            if (regs.status.vcount_coincidence_irq)
-            {
-                mmu->interrupt_request_flags |= 4u;
-            }
+        for (size_t i = 0; i < job->vram_chunks.size(); i++)
+        {
+            std::memcpy(render_vram.data() + (job->vram_chunks[i] * VRAM_CHUNK_SIZE),
+                        job->vram_data.data() + (i * VRAM_CHUNK_SIZE), VRAM_CHUNK_SIZE);
+        }
+
+        line_regs = &job->regs;
+        line_vram = render_vram.data();
+        line_palette_ram = job->palette_ram.data();
+        line_framebuffer = framebuffers[back_buffer].data();
+
+        try
+        {
+            draw_scanline();
+        }
+        catch (const std::runtime_error &)
+        {
+            render_exception = std::current_exception();
+            render_failed.store(true, std::memory_order_release);
+
+            return;
+        }
+
+        // In Threaded mode a finished frame becomes the presented one. The emulation thread presents a frame
+        // before it queues any line of the next one, so it never reads the buffer being drawn
+        if ((render_mode == RENDER_MODE::Threaded) && (job->regs.vcount == 159))
+        {
+            front_buffer.store(back_buffer, std::memory_order_release);
+            back_buffer ^= 1u;
+        }
+
+        render_queue.pop();
+    }
+}
+
+void LCD::stop_render_thread()
+{
+    if (render_thread.joinable())
+    {
+        while (!render_queue.empty() && !render_failed.load(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+
+        render_running.store(false);
+        render_thread.join();
+    }
+}
+
+void LCD::hblank(const uint64_t timestamp)
+{
+    if (regs.vcount < 160)
+    {
+        if (render_mode == RENDER_MODE::Serial)
+        {
+            draw_scanline();
         }
         else
         {
-            regs.status.vcount_coincidence = false;
+            submit_scanline();
         }
 
-        regs.status.hblank = false;
+        mmu->dma->trigger(DMA_TIMING::HBlank);
+    }
+
+    regs.status.hblank = true;
+
+    if (regs.status.hblank_irq)
+    {
+        mmu->interrupts->request(INTERRUPT::Interrupt_HBlank);
+    }
+
+    mmu->scheduler->add_event(EVENT_TYPE::LCD_HDraw, timestamp + HBLANK_CYCLES);
+}
+
+void LCD::hdraw(const uint64_t timestamp)
+{
+    regs.vcount = (regs.vcount + 1u) % 228u;
+    regs.status.hblank = false;
+
+    if (regs.vcount == regs.status.vcount_setting)
+    {
+        regs.status.vcount_coincidence = true;
+
+        if (regs.status.vcount_coincidence_irq)
+        {
+            mmu->interrupts->request(INTERRUPT::Interrupt_VCount);
+        }
+    }
+    else
+    {
+        regs.status.vcount_coincidence = false;
     }
 
     switch (regs.vcount)
     {
         case 160:
-            if (lcd_cycle == 0)
-            {
-                regs.status.vblank = true;
+            regs.status.vblank = true;
 
-                if (regs.status.vblank_irq)
-                {
-                    mmu->interrupt_request_flags |= 1u;
-                }
+            if (regs.status.vblank_irq)
+            {
+                mmu->interrupts->request(INTERRUPT::Interrupt_VBlank);
             }
+
+            mmu->dma->trigger(DMA_TIMING::VBlank);
             break;
         case 227:
-            if (lcd_cycle == 0)
-            {
-                regs.status.vblank = false;
+            regs.status.vblank = false;
 
-                mmu->gba->draw_framebuffer(framebuffer.data());
-            }
-            break;
-        case 228:
-            regs.vcount = 0;
+            mmu->gba->draw_framebuffer(get_framebuffer());
             break;
         default:
             break;
     }
+
+    mmu->scheduler->add_event(EVENT_TYPE::LCD_HBlank, timestamp + HDRAW_CYCLES);
 }
 
-void LCD::draw_pixel(const uint16_t x, const uint16_t y, const uint16_t color)
+void LCD::draw_scanline()
 {
-    uint32_t offset = (2u * x) + (2u * 240u * y);
-    uint16_t color_swapped = ((color & 0x1Fu) << 10u) | (color & 0x3E0u) | ((color & 0x7C00u) >> 10u);
-
-    *(uint16_t*)(framebuffer.data() + offset) = color_swapped;
+    (this->*modes[line_regs->control.bg_mode])();
 }
 
-Pixel LCD::mode_0_get_bg(const size_t bg)
+void LCD::draw_color_line()
 {
-    static uint8_t tile_offset[2] = { 32, 64 };
+    auto *line = (uint16_t*)(line_framebuffer + (2u * 240u * line_regs->vcount));
+    size_t x = 0;
 
-    uint32_t c_x = (regs.bg[bg].bghofs + regs.bg[bg].current_x) % (map_width[regs.bg[bg].control.bg_size] * 8u);
-    uint32_t c_y = (regs.bg[bg].bgvofs + regs.vcount) % (map_height[regs.bg[bg].control.bg_size] * 8u);
-    uint32_t map_offset = get_map_offset(c_x, c_y);
+#ifdef __SSE2__
+    const __m128i red_mask  = _mm_set1_epi16(0x1F);
+    const __m128i green_mask = _mm_set1_epi16(0x3E0);
 
-    if (c_x > 255)
+    for (; x < 240; x += 8)
     {
-        c_x %= 256u;
+        __m128i color = _mm_loadu_si128((const __m128i*)(color_line.data() + x));
+        __m128i red   = _mm_slli_epi16(_mm_and_si128(color, red_mask), 10);
+        __m128i green = _mm_and_si128(color, green_mask);
+        __m128i blue  = _mm_and_si128(_mm_srli_epi16(color, 10), red_mask);
+
+        _mm_storeu_si128((__m128i*)(line + x), _mm_or_si128(_mm_or_si128(red, green), blue));
     }
-    if (c_y > 255)
+#endif
+
+    for (; x < 240; x++)
     {
-        c_y %= 256u;
+        uint16_t color = color_line[x];
+
+        line[x] = ((color & 0x1Fu) << 10u) | (color & 0x3E0u) | ((color & 0x7C00u) >> 10u);
     }
+}
 
-    uint32_t set_addr = 0x6000000u | (SET_SIZE * regs.bg[bg].control.character_base_block);
-    uint32_t map_addr = 0x6000000u | (MAP_SIZE * regs.bg[bg].control.screen_base_block);
+void LCD::render_text_bg(const size_t bg)
+{
+    static uint8_t tile_offset[2] = { 32, 64 };
 
-    uint32_t map_index = (uint32_t) (c_x / 8u) + 32 * (uint32_t)(c_y / 8u);
+    uint16_t *line = bg_lines[bg].data();
 
-    uint16_t tile_index = mmu->read16(map_addr + map_offset + map_index * 2u);
-    uint32_t tile_addr = set_addr + (tile_index & 0x3FFu) * tile_offset[(size_t)regs.bg[bg].control.color_mode];
-    uint8_t palette_index;
-    uint8_t priority = regs.bg[bg].control.priority;
-    uint8_t p_index  = 0;
+    uint32_t width  = map_width[line_regs->bg[bg].control.bg_size] * 8u;
+    uint32_t height = map_height[line_regs->bg[bg].control.bg_size] * 8u;
 
-    if (regs.bg[bg].control.color_mode)
-    {
-        palette_index = mmu->read8(tile_addr + ((c_x ^ (7u * ((tile_index >> 10u) & 1u))) % 8u)
-                                   + 8u * ((c_y ^ (7u * ((tile_index >> 11u) & 1u))) % 8u));
-    }
-    else
+    uint32_t c_x = line_regs->bg[bg].bghofs % width;
+    uint32_t c_y = (line_regs->bg[bg].bgvofs + line_regs->vcount) % height;
+
+    uint32_t set_offset = SET_SIZE * line_regs->bg[bg].control.character_base_block;
+    uint32_t map_offset = MAP_SIZE * line_regs->bg[bg].control.screen_base_block;
+
+    bool color_mode = line_regs->bg[bg].control.color_mode;
+    uint16_t key = (uint16_t)((line_regs->bg[bg].control.priority * 4u + bg) << 8u);
+
+    uint32_t x = 0;
+
+    // Decode one tile row at a time, the map entry and tile data only change every 8 dots
+    while (x < 240)
     {
-        uint32_t n_tile_addr = tile_addr + ((c_x ^ (7u * ((tile_index >> 10u) & 1u))) % 8u) / 2u
-                               + 4 * ((c_y ^ (7u * ((tile_index >> 11u) & 1u))) % 8u);
-        p_index = mmu->read8(n_tile_addr);
+        uint32_t map_index = ((c_x % 256u) / 8u) + 32u * ((c_y % 256u) / 8u);
+        uint16_t tile_index = *(uint16_t*)(line_vram + map_offset + get_map_offset(c_x, c_y) + map_index * 2u);
 
-        if (((tile_index >> 10u) & 1u) != 0)
-        {
-            p_index = (p_index << 4u) | (p_index >> 4u);
-        }
+        uint32_t tile_row  = (c_y % 8u) ^ (7u * ((tile_index >> 11u) & 1u));
+        uint32_t flip_x    = 7u * ((tile_index >> 10u) & 1u);
+        uint32_t tile_addr = set_offset + (tile_index & 0x3FFu) * tile_offset[(size_t)color_mode];
 
-        if ((c_x & 1u) == 1)
+        if (color_mode)
         {
-            p_index >>= 4u;
-        }
+            uint8_t tile_data[8];
 
-        p_index &= 0xFu;
-        palette_index = 16u * (tile_index >> 12u) + p_index;
-    }
+            std::memcpy(tile_data, line_vram + get_vram_offset(tile_addr + 8u * tile_row), 8);
 
-    if ((regs.dispcnt & (0x100 << bg)) == 0)
-    {
-        palette_index = 0;
-        priority = 4;
-    }
+            for (uint32_t p_x = c_x % 8u; (p_x < 8) && (x < 240); p_x++, x++)
+            {
+                uint8_t palette_index = tile_data[p_x ^ flip_x];
 
-    if (!regs.bg[bg].control.color_mode && p_index == 0)
-    {
-        palette_index = 0;
-        priority = 4;
-    }
+                line[x] = (palette_index == 0) ? TRANSPARENT_PIXEL : (key | palette_index);
+            }
+        }
+        else
+        {
+            uint32_t tile_data;
+            uint16_t palette_bank = 16u * (tile_index >> 12u);
+
+            std::memcpy(&tile_data, line_vram + get_vram_offset(tile_addr + 4u * tile_row), 4);
 
-    ++regs.bg[bg].current_x;
+            for (uint32_t p_x = c_x % 8u; (p_x < 8) && (x < 240); p_x++, x++)
+            {
+                uint8_t p_index = (tile_data >> (4u * (p_x ^ flip_x))) & 0xFu;
+
+                line[x] = (p_index == 0) ? TRANSPARENT_PIXEL : (key | (palette_bank + p_index));
+            }
+        }
 
-    return Pixel(palette_index, priority);
+        c_x = ((c_x | 7u) + 1u) % width;
+    }
 }
 
 void LCD::mode_0()
 {
-    if (lcd_cycle >= 240 || regs.vcount >= 160)
+    if (line_regs->control.forced_blank)
     {
-        for (auto &i : regs.bg)
-        {
-            i.current_x = 0;
-        }
+        color_line.fill(0xFFFF);
+
+        draw_color_line();
 
         return;
     }
 
-    Pixel bg_pixels[4];
-    Pixel final_pixel = Pixel(0, 4);
+    std::array<size_t, 4> enabled_bgs = {};
+    size_t bg_count = 0;
 
-    for (size_t i = 0; i < 4; i++)
+    for (size_t bg = 0; bg < 4; bg++)
     {
-        bg_pixels[i] = mode_0_get_bg(i);
+        if ((line_regs->dispcnt & (0x100u << bg)) != 0)
+        {
+            render_text_bg(bg);
+
+            enabled_bgs[bg_count++] = bg;
+        }
     }
 
-    for (size_t i = 4; i > 0; i--)
+    // Select the BG pixel with the lowest key, ties can't happen since the key includes the BG number
+    size_t x = 0;
+
+#ifdef __SSE2__
+    for (; x < 240; x += 8)
     {
-        size_t index = i - 1u;
+        __m128i pixel = _mm_set1_epi16(TRANSPARENT_PIXEL);
 
-        if (bg_pixels[index].priority <= final_pixel.priority)
+        for (size_t i = 0; i < bg_count; i++)
         {
-            final_pixel.p_index  = bg_pixels[index].p_index;
-            final_pixel.priority = bg_pixels[index].priority;
+            pixel = _mm_min_epi16(pixel, _mm_loadu_si128((const __m128i*)(bg_lines[enabled_bgs[i]].data() + x)));
         }
+
+        _mm_storeu_si128((__m128i*)(color_line.data() + x), pixel);
     }
+#endif
 
-    if (regs.control.forced_blank)
+    for (; x < 240; x++)
     {
-        draw_pixel(lcd_cycle, regs.vcount, 0xFFFF);
+        uint16_t pixel = TRANSPARENT_PIXEL;
+
+        for (size_t i = 0; i < bg_count; i++)
+        {
+            pixel = std::min(pixel, bg_lines[enabled_bgs[i]][x]);
+        }
+
+        color_line[x] = pixel;
     }
-    else
+
+    for (auto &pixel : color_line)
     {
-        draw_pixel(lcd_cycle, regs.vcount, *(uint16_t*)(mmu->palette_ram.data() + (final_pixel.p_index * 2u) +
-                ((final_pixel.sprite) ? 0x200 : 0)));
+        pixel = *(uint16_t*)(line_palette_ram + ((pixel & 0xFFu) * 2u));
     }
+
+    draw_color_line();
 }
 
 void LCD::mode_3()
 {
-    if (lcd_cycle >= 240 || regs.vcount >= 160)
+    if (line_regs->control.forced_blank)
     {
-        return;
-    }
-
-    if (regs.control.forced_blank)
-    {
-        draw_pixel(lcd_cycle, regs.vcount, 0xFFFF);
+        color_line.fill(0xFFFF);
     }
     else
     {
-        uint16_t color = *(uint16_t*)(mmu->vram.data() + ((lcd_cycle + (240u * regs.vcount)) * 2u));
-
-        draw_pixel(lcd_cycle, regs.vcount, color);
+        std::memcpy(color_line.data(), line_vram + (2u * 240u * line_regs->vcount), 2u * 240u);
     }
+
+    draw_color_line();
 }
 
 void LCD::mode_4()
 {
-    if (lcd_cycle >= 240 || regs.vcount >= 160)
-    {
-        return;
-    }
-
-    if (regs.control.forced_blank)
+    if (line_regs->control.forced_blank)
     {
-        draw_pixel(lcd_cycle, regs.vcount, 0xFFFF);
+        color_line.fill(0xFFFF);
     }
     else
     {
-        uint8_t  palette_index = mmu->vram[lcd_cycle + (240u * regs.vcount)];
-        uint16_t color = *(uint16_t*)(mmu->palette_ram.data() + (palette_index * 2u));
+        for (uint16_t x = 0; x < 240; x++)
+        {
+            uint8_t palette_index = line_vram[x + (240u * line_regs->vcount)];
 
-        draw_pixel(lcd_cycle, regs.vcount, color);
+            color_line[x] = *(uint16_t*)(line_palette_ram + (palette_index * 2u));
+        }
     }
+
+    draw_color_line();
 }
 
 void LCD::unknown_mode()
 {
-    if (regs.control.forced_blank)
+    if (line_regs->control.forced_blank)
     {
         return;
     }
 
-    printf("BG mode: %u\n", regs.control.bg_mode);
+    printf("BG mode: %u\n", line_regs->control.bg_mode);
 
     throw std::runtime_error("Unknown BG mode!");
 }
-
-void LCD::run()
-{
-    (this->*modes[regs.control.bg_mode])();
-    tick();
-}
@@ -22,29 +22,17 @@
 
 
 #include "lcd_registers.h"
+#include "lcd_render.h"
+
+#include "../utils/spsc_queue.h"
 
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
 #include <vector>
 
-struct Pixel
-{
-    Pixel() :
-    p_index(0), priority(0), sprite(false)
-    {
-
-    }
-
-    Pixel (uint8_t p_index, uint8_t priority, bool sprite = false) :
-            p_index(p_index), priority(priority), sprite(sprite)
-    {
-
-    }
-
-    uint8_t p_index;
-    uint8_t priority;
-    bool sprite;
-};
-
 class MMU;
 
 class LCD
@@ -52,28 +40,63 @@ class LCD
 private:
     MMU *mmu;
 
-    uint16_t lcd_cycle;
+    // Scanline buffers. Background lines hold the composition key (priority * 4 + BG number, lowest wins)
+    // in the high byte and the palette index in the low byte, the color line holds BGR555 colors
+    std::array<std::array<uint16_t, 240>, 4> bg_lines;
+    std::array<uint16_t, 240> color_line;
 
-    inline void tick();
-    inline void draw_pixel(uint16_t x, uint16_t y, uint16_t color);
+    // State the scanline is drawn from, either the live state or a render job on the render thread
+    const LCD_Registers *line_regs;
+    const uint8_t *line_vram;
+    const uint8_t *line_palette_ram;
+    uint8_t *line_framebuffer;
 
-    std::array<void(LCD::*)(), 6> modes;
+    inline void draw_scanline();
+    inline void draw_color_line();
 
-    inline Pixel mode_0_get_bg(size_t bg);
+    std::array<void(LCD::*)(), 8> modes;
+
+    inline void render_text_bg(size_t bg);
 
     inline void mode_0();
     inline void mode_3();
     inline void mode_4();
     inline void unknown_mode();
+
+    RENDER_MODE render_mode;
+
+    std::array<std::vector<uint8_t>, 2> framebuffers;
+
+    // Framebuffer presented at the end of a frame and framebuffer the render thread draws into
+    std::atomic<size_t> front_buffer;
+    size_t back_buffer;
+
+    SPSC_Queue<Render_Job, 16> render_queue;
+    std::vector<uint8_t> render_vram;
+
+    std::thread render_thread;
+    std::atomic<bool> render_running;
+    std::atomic<bool> render_failed;
+    std::exception_ptr render_exception;
+
+    inline void submit_scanline();
+    inline void wait_for_render_thread();
+    inline void check_render_thread();
+    void run_render_thread();
+    void stop_render_thread();
 public:
     explicit LCD(MMU *mmu);
     ~LCD();
 
     LCD_Registers regs;
 
-    std::vector<uint8_t> framebuffer;
+    void set_render_mode(RENDER_MODE mode);
+
+    // Waits for queued scanlines in Deterministic mode
+    [[nodiscard]] const uint8_t *get_framebuffer();
 
-    void run();
+    void hblank(uint64_t timestamp);
+    void hdraw(uint64_t timestamp);
 };
 
 
@@ -44,8 +44,6 @@ struct BG
 
     uint16_t bghofs;
     uint16_t bgvofs;
-
-    uint8_t current_x;
 };
 
 struct LCD_Registers
@@ -0,0 +1,52 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_LCD_RENDER_H
+#define AMAZINGLY_ADVANCED_LCD_RENDER_H
+
+
+#include "lcd_registers.h"
+
+#include <array>
+#include <cinttypes>
+#include <vector>
+
+// Serial draws scanlines on the emulation thread. Threaded hands them to a render thread and presents the
+// last completed frame, which may lag one frame behind. Deterministic uses the render thread but waits for it
+// at the end of every frame, so the output is identical to Serial
+enum RENDER_MODE
+{
+    Serial,
+    Threaded,
+    Deterministic
+};
+
+// Snapshot of everything the render thread needs to draw one scanline
+struct Render_Job
+{
+    LCD_Registers regs;
+
+    std::array<uint8_t, 0x400> palette_ram;
+
+    // 1 KiB VRAM chunks written since the previous job and their contents
+    std::vector<uint8_t> vram_chunks;
+    std::vector<uint8_t> vram_data;
+};
+
+
+#endif //AMAZINGLY_ADVANCED_LCD_RENDER_H
@@ -18,10 +18,39 @@
 
 #include "cartridge.h"
 
-Cartridge::Cartridge(const char *const rom_path)
+const size_t MAX_ROM_SIZE = 0x2000000;
+
+Cartridge::Cartridge(const char *const rom_path) :
+data(load_file(rom_path)), cart_bounds(data.size())
 {
-    data = load_file(rom_path);
-    cart_bounds = data.size() - 2u;
+    if (cart_bounds == 0 || cart_bounds > MAX_ROM_SIZE)
+    {
+        spdlog::get("AmazinglyAdvanced")->error("Invalid ROM size {}!", cart_bounds);
+
+        throw std::runtime_error("Invalid ROM size!");
+    }
+
+    size_t padded_size = 2;
+
+    while (padded_size < cart_bounds)
+    {
+        padded_size <<= 1u;
+    }
+
+    data.resize(padded_size);
+
+    // Odd-sized ROMs get their last halfword completed from the open bus pattern as well
+    for (size_t offset = cart_bounds & ~(size_t)1u; offset < padded_size; offset += 2u)
+    {
+        uint16_t open_bus = get_open_bus(offset);
+
+        if (offset >= cart_bounds)
+        {
+            data[offset] = open_bus & 0xFFu;
+        }
+
+        data[offset + 1u] = open_bus >> 8u;
+    }
 }
 
 Cartridge::~Cartridge()
@@ -30,9 +30,17 @@ public:
     explicit Cartridge(const char *rom_path);
     ~Cartridge();
 
+    // ROM image padded to the next power of two with the open bus pattern
     std::vector<uint8_t> data;
 
+    // Size of the ROM image itself
     size_t cart_bounds;
+
+    // Reads past the end of the ROM return the lower 16 bits of the halfword address
+    [[nodiscard]] static constexpr uint16_t get_open_bus(const uint32_t address)
+    {
+        return (address >> 1u) & 0xFFFFu;
+    }
 };
 
 
@@ -20,6 +20,8 @@
 
 #include "../mmu.h"
 #include "dma_channels.h"
+#include "../../interrupts/interrupts.h"
+#include "../../scheduler/scheduler.h"
 
 DMA::DMA(MMU *const mmu) :
 mmu(mmu), channels()
@@ -30,12 +32,6 @@ mmu(mmu), channels()
 DMA::~DMA()
 = default;
 
-bool DMA::is_enabled() const
-{
-    return channels[0].control.enable || channels[1].control.enable ||
-           channels[2].control.enable || channels[3].control.enable;
-}
-
 bool DMA::is_running() const
 {
     return channels[0].is_running || channels[1].is_running || channels[2].is_running || channels[3].is_running;
@@ -55,6 +51,25 @@ void DMA::set_control(const size_t channel, const uint16_t value)
         channels[channel].d_addr = channels[channel].dmadad;
         channels[channel].count = ((channels[channel].control.dmacnt_l != 0) ?
                                     channels[channel].control.dmacnt_l : ((channel == 3) ? 0x10000 : 0x4000));
+
+        switch (channels[channel].control.timing)
+        {
+            case DMA_TIMING::Immediate:
+                start(channel);
+                break;
+            case DMA_TIMING::VBlank:
+            case DMA_TIMING::HBlank:
+                break;
+            case DMA_TIMING::Special:
+            default:
+                console->error("Unhandled DMA start condition!");
+
+                throw std::runtime_error("Unhandled DMA start condition");
+        }
+    }
+    else if (!channels[channel].control.enable)
+    {
+        channels[channel].is_running = false;
     }
 }
 
@@ -79,102 +94,113 @@ void DMA::set_s_addr(const size_t channel, const uint32_t s_addr)
     channels[channel].dmasad = s_addr;
 }
 
-void DMA::check_start_cond()
+void DMA::start(const size_t channel)
+{
+    channels[channel].is_running = true;
+
+    // Transfers start two cycles after the start condition is met
+    if (!mmu->scheduler->is_scheduled(EVENT_TYPE::DMA_Transfer))
+    {
+        mmu->scheduler->add_event(EVENT_TYPE::DMA_Transfer, mmu->scheduler->get_timestamp() + 2u);
+    }
+}
+
+void DMA::trigger(const DMA_TIMING timing)
 {
-    for (auto & channel : channels)
+    for (size_t i = 0; i < 4; i++)
     {
-        if (channel.control.enable && !channel.is_running)
+        if (channels[i].control.enable && !channels[i].is_running && channels[i].control.timing == timing)
         {
-            switch (channel.control.timing)
-            {
-                case 0:
-                    channel.is_running = true;
-                    break;
-                case 1:
-                case 2:
-                case 3:
-                default:
-                    console->error("Unhandled DMA start condition!");
-
-                    throw std::runtime_error("Unhandled DMA start condition");
-            }
+            start(i);
         }
     }
 }
 
+void DMA::transfer(const size_t channel)
+{
+    bool word = channels[channel].control.type;
+    bool sequential = false;
+    uint64_t cycles = 2;
+
+    while (channels[channel].count != 0)
+    {
+        cycles += mmu->get_access_cycles(channels[channel].s_addr, sequential, word) +
+                  mmu->get_access_cycles(channels[channel].d_addr, sequential, word);
+        sequential = true;
+
+        if (word)
+        {
+            mmu->write32(mmu->read32(channels[channel].s_addr), channels[channel].d_addr);
+        }
+        else
+        {
+            mmu->write16(mmu->read16(channels[channel].s_addr), channels[channel].d_addr);
+        }
+
+        switch (channels[channel].control.da_control)
+        {
+            case 0:
+            case 3:
+                channels[channel].d_addr += ((word) ? 4u : 2u);
+                break;
+            case 1:
+                channels[channel].d_addr -= ((word) ? 4u : 2u);
+                break;
+            case 2:
+            default:
+                break;
+        }
+
+        switch (channels[channel].control.sa_control)
+        {
+            case 0:
+                channels[channel].s_addr += ((word) ? 4u : 2u);
+                break;
+            case 1:
+                channels[channel].s_addr -= ((word) ? 4u : 2u);
+                break;
+            case 2:
+            case 3:
+            default:
+                break;
+        }
+
+        --channels[channel].count;
+    }
+
+    if (channels[channel].control.repeat)
+    {
+        channels[channel].count = ((channels[channel].control.dmacnt_l != 0) ?
+                                   channels[channel].control.dmacnt_l : ((channel == 3) ? 0x10000 : 0x4000));
+
+        if (channels[channel].control.da_control == 3)
+        {
+            channels[channel].d_addr = channels[channel].dmadad;
+        }
+    }
+    else
+    {
+        channels[channel].control.enable = false;
+    }
+
+    if (channels[channel].control.irq)
+    {
+        mmu->interrupts->request(INTERRUPT::Interrupt_DMA0 << channel);
+    }
+
+    channels[channel].is_running = false;
+
+    mmu->scheduler->add_cycles(cycles);
+}
+
 void DMA::run()
 {
+    // Transfers run to completion, channel 0 has the highest priority
     for (size_t i = 0; i < 4; i++)
     {
         if (channels[i].is_running)
         {
-            //console->info("DMA{} is running - Count: {:08X}h", i, channels[i].count);
-
-            if (channels[i].control.type)
-            {
-                mmu->write32(mmu->read32(channels[i].s_addr), channels[i].d_addr);
-            }
-            else
-            {
-                mmu->write16(mmu->read16(channels[i].s_addr), channels[i].d_addr);
-            }
-
-            switch (channels[i].control.da_control)
-            {
-                case 0:
-                case 3:
-                    channels[i].d_addr += ((channels[i].control.type) ? 4u : 2u);
-                    break;
-                case 1:
-                    channels[i].d_addr -= ((channels[i].control.type) ? 4u : 2u);
-                    break;
-                case 2:
-                default:
-                    break;
-            }
-
-            switch (channels[i].control.sa_control)
-            {
-                case 0:
-                    channels[i].s_addr += ((channels[i].control.type) ? 4u : 2u);
-                    break;
-                case 1:
-                    channels[i].s_addr -= ((channels[i].control.type) ? 4u : 2u);
-                    break;
-                case 2:
-                case 3:
-                default:
-                    break;
-            }
-
-            --channels[i].count;
-
-            if (channels[i].count == 0)
-            {
-                if (channels[i].control.repeat)
-                {
-                    channels[i].count = ((channels[i].control.dmacnt_l != 0) ?
-                                         channels[i].control.dmacnt_l : ((i == 3) ? 0x10000 : 0x4000));
-
-                    if (channels[i].control.da_control == 3)
-                    {
-                        channels[i].d_addr = channels[i].dmadad;
-                    }
-                }
-                else
-                {
-                    channels[i].control.enable = false;
-                }
-
-                if (channels[i].control.irq)
-                {
-                    mmu->interrupt_request_flags |= (0x100u << i);
-                }
-
-                channels[i].is_running = false;
-            }
-
-            return;
+            transfer(i);
         }
     }
 }
@@ -35,13 +35,15 @@ private:
     MMU *mmu;
 
     std::shared_ptr<spdlog::logger> console;
+
+    inline void start(size_t channel);
+    inline void transfer(size_t channel);
 public:
     explicit DMA(MMU *mmu);
     ~DMA();
 
     DMA_Channels channels[4];
 
-    [[nodiscard]] bool is_enabled() const;
     [[nodiscard]] bool is_running() const;
 
     void set_control(size_t channel, uint16_t value);
@@ -49,7 +51,7 @@ public:
     void set_d_addr(size_t channel, uint32_t d_addr);
     void set_s_addr(size_t channel, uint32_t s_addr);
 
-    void check_start_cond();
+    void trigger(DMA_TIMING timing);
     void run();
 };
 
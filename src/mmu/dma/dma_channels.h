@@ -23,6 +23,14 @@
 
 #include <cinttypes>
 
+enum DMA_TIMING
+{
+    Immediate = 0,
+    VBlank    = 1,
+    HBlank    = 2,
+    Special   = 3
+};
+
 struct DMA_Channels
 {
     uint32_t dmasad;
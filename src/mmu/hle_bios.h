@@ -0,0 +1,61 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_HLE_BIOS_H
+#define AMAZINGLY_ADVANCED_HLE_BIOS_H
+
+
+#include <cinttypes>
+#include <vector>
+
+// Stand-in for the BIOS image when none is given. SWIs are handled by the CPU's HLE layer, so this only
+// needs exception vectors that return and the IRQ handler that calls the user handler at 0x3FFFFFC
+inline std::vector<uint8_t> make_hle_bios()
+{
+    const uint32_t code[][2] = {
+        { 0x000, 0xEAFFFFFE }, // b      0x00
+        { 0x004, 0xE1B0F00E }, // movs   pc, lr
+        { 0x008, 0xE1B0F00E }, // movs   pc, lr
+        { 0x00C, 0xE25EF004 }, // subs   pc, lr, #4
+        { 0x010, 0xE25EF008 }, // subs   pc, lr, #8
+        { 0x018, 0xEA000042 }, // b      0x128
+        { 0x01C, 0xE25EF004 }, // subs   pc, lr, #4
+        { 0x128, 0xE92D500F }, // stmfd  sp!, {r0-r3, r12, lr}
+        { 0x12C, 0xE3A00301 }, // mov    r0, #0x4000000
+        { 0x130, 0xE28FE000 }, // add    lr, pc, #0
+        { 0x134, 0xE510F004 }, // ldr    pc, [r0, #-4]
+        { 0x138, 0xE8BD500F }, // ldmfd  sp!, {r0-r3, r12, lr}
+        { 0x13C, 0xE25EF004 }, // subs   pc, lr, #4
+    };
+
+    std::vector<uint8_t> bios(0x4000, 0);
+
+    for (const auto &instruction : code)
+    {
+        for (uint32_t byte = 0; byte < 4; byte++)
+        {
+            bios[instruction[0] + byte] = (uint8_t)(instruction[1] >> (byte * 8u));
+        }
+    }
+
+    return bios;
+}
+
+
+#endif //AMAZINGLY_ADVANCED_HLE_BIOS_H
@@ -0,0 +1,43 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_IO_REGISTERS_H
+#define AMAZINGLY_ADVANCED_IO_REGISTERS_H
+
+
+#include <cinttypes>
+
+class MMU;
+
+// Descriptor for one halfword of I/O space. Accesses of any width are composed from halfword accesses,
+// write callbacks receive a mask of the bits being written so byte writes leave the other byte alone
+struct IO_Register
+{
+    uint16_t (*read)(const MMU &mmu, uint32_t address);
+    void (*write)(MMU &mmu, uint32_t address, uint16_t value, uint16_t mask);
+
+    // Implemented bits, unused bits read as 0 and ignore writes
+    uint16_t width_mask;
+
+    // Accesses do more than load or store the value (starting DMAs and timers, acknowledging IRQs, polling input)
+    bool side_effects;
+};
+
+
+#endif //AMAZINGLY_ADVANCED_IO_REGISTERS_H
@@ -0,0 +1,46 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_MEMORY_REGIONS_H
+#define AMAZINGLY_ADVANCED_MEMORY_REGIONS_H
+
+
+#include <cinttypes>
+#include <vector>
+
+constexpr uint32_t PAGE_SHIFT = 14;
+constexpr uint32_t PAGE_SIZE  = 1u << PAGE_SHIFT;
+constexpr uint32_t PAGE_MASK  = PAGE_SIZE - 1u;
+
+// Granularity of WRAM write tracking for cached code
+constexpr uint32_t CODE_PAGE_SHIFT = 8;
+constexpr uint32_t CODE_PAGE_SIZE  = 1u << CODE_PAGE_SHIFT;
+constexpr uint32_t CODE_PAGE_MASK  = CODE_PAGE_SIZE - 1u;
+
+// One 16 MiB region (address bits 24-27). The address is mirrored by mask, then split into 16 KiB pages
+// pointing to host memory. Null pages are handled by the slow path.
+struct Memory_Region
+{
+    uint32_t mask;
+
+    std::vector<uint8_t *> pages;
+};
+
+
+#endif //AMAZINGLY_ADVANCED_MEMORY_REGIONS_H
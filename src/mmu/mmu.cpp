@@ -20,72 +20,635 @@
 
 #include "cartridge/cartridge.h"
 #include "dma/dma.h"
+#include "../cpu/cpu.h"
 #include "../gba.h"
+#include "../interrupts/interrupts.h"
 #include "../lcd/lcd.h"
 #include "dma/dma_channels.h"
+#include "hle_bios.h"
+#include "../scheduler/scheduler.h"
 #include "../timer/timer.h"
+#include "../utils/profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+const uint8_t n_waitstates[4] = { 4, 3, 2, 8 };
 
 constexpr bool in_range(const uint32_t address, const uint32_t lower, const uint32_t upper)
 {
     return (address >= lower) && (address < upper);
 }
 
+constexpr size_t io_index(const uint32_t address)
+{
+    return (address & 0x3FEu) >> 1u;
+}
+
+constexpr void set_bits(uint16_t &field, const uint16_t value, const uint16_t mask)
+{
+    field = (field & (uint16_t)~mask) | (value & mask);
+}
+
 MMU::MMU(const char *const bios_path, const char *const rom_path, GBA *gba) :
-wram_board(0x40000, 0), wram_chip(0x8000, 0), palette_ram(0x400, 0),
-vram(0x18000, 0), oam(0x400, 0), gba(gba), interrupt_master_enable(0), interrupt_enable(0), interrupt_request_flags(0),
-sound_bias(0)
+cpu(nullptr), wram_board(0x40000, 0), wram_chip(0x8000, 0), palette_ram(0x400, 0),
+vram(0x18000, 0), oam(0x400, 0), io_table(), io_storage(), code_bitmap(), vram_dirty(), timer_read(false), cycles_n16(), cycles_s16(), cycles_n32(), cycles_s32(), waitcnt(0), gba(gba)
 {
     console = spdlog::stdout_color_mt("MMU");
 
-    bios  = load_file(bios_path, true, 0x4000);
+    set_waitcnt(0);
+
+    scheduler  = std::make_unique<Scheduler>();
+    interrupts = std::make_unique<Interrupts>();
+
+    bios  = (bios_path != nullptr) ? load_file(bios_path, true, 0x4000) : make_hle_bios();
     cart  = std::make_unique<Cartridge>(rom_path);
     dma   = std::make_unique<DMA>(this);
     lcd   = std::make_unique<LCD>(this);
     timer = std::make_unique<Timer>(this);
+
+    fill_io_table();
+    fill_page_tables();
 }
 
 MMU::~MMU()
 = default;
 
-uint8_t MMU::read8(const uint32_t address) const
+void MMU::set_waitcnt(const uint16_t value)
 {
-    uint32_t addr_masked = address & 0x0FFFFFFFu;
+    static const uint8_t ws0_s[2] = { 2, 1 };
+    static const uint8_t ws1_s[2] = { 4, 1 };
+    static const uint8_t ws2_s[2] = { 8, 1 };
 
-    if (in_range(addr_masked, 0, 0x4000))
+    waitcnt = value & 0x5FFFu;
+
+    // BIOS, IWRAM, I/O and OAM have a 32-bit bus and no wait states
+    cycles_n16.fill(1);
+    cycles_s16.fill(1);
+    cycles_n32.fill(1);
+    cycles_s32.fill(1);
+
+    // EWRAM has a 16-bit bus and 2 wait states
+    cycles_n16[0x2] = cycles_s16[0x2] = 3;
+    cycles_n32[0x2] = cycles_s32[0x2] = 6;
+
+    // Palette RAM and VRAM have a 16-bit bus
+    cycles_n32[0x5] = cycles_s32[0x5] = 2;
+    cycles_n32[0x6] = cycles_s32[0x6] = 2;
+
+    const uint8_t rom_n[3] = { n_waitstates[(value >> 2u) & 3u], n_waitstates[(value >> 5u) & 3u],
+                               n_waitstates[(value >> 8u) & 3u] };
+    const uint8_t rom_s[3] = { ws0_s[(value >> 4u) & 1u], ws1_s[(value >> 7u) & 1u], ws2_s[(value >> 10u) & 1u] };
+
+    // Game Pak ROM has a 16-bit bus, 32-bit accesses are split into a non-sequential and a sequential access
+    for (size_t i = 0; i < 3; i++)
     {
-        return bios[addr_masked];
+        for (size_t region = 0x8u + 2u * i; region < 0xAu + 2u * i; region++)
+        {
+            cycles_n16[region] = 1u + rom_n[i];
+            cycles_s16[region] = 1u + rom_s[i];
+            cycles_n32[region] = cycles_n16[region] + cycles_s16[region];
+            cycles_s32[region] = 2u * cycles_s16[region];
+        }
     }
-    else if (in_range(addr_masked, 0x2000000, 0x3000000))
+
+    // Game Pak SRAM has an 8-bit bus
+    cycles_n16[0xE] = cycles_s16[0xE] = cycles_n32[0xE] = cycles_s32[0xE] = 1u + n_waitstates[value & 3u];
+    cycles_n16[0xF] = cycles_s16[0xF] = cycles_n32[0xF] = cycles_s32[0xF] = 1u + n_waitstates[value & 3u];
+}
+
+void MMU::fill_io_table()
+{
+    IO_Register storage = {
+        [](const MMU &mmu, const uint32_t address) -> uint16_t { return mmu.io_storage[io_index(address)]; },
+        [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+        {
+            set_bits(mmu.io_storage[io_index(address)], value, mask);
+        },
+        0xFFFF, false
+    };
+
+    IO_Register write_only = storage;
+
+    write_only.read = nullptr;
+
+    io_table.fill({ nullptr, nullptr, 0, false });
+
+    // LCD
+    io_table[io_index(0x4000000)] = {
+        [](const MMU &mmu, uint32_t) -> uint16_t { return mmu.lcd->regs.dispcnt; },
+        [](MMU &mmu, uint32_t, const uint16_t value, const uint16_t mask)
+        {
+            set_bits(mmu.lcd->regs.dispcnt, value, mask);
+
+            mmu.console->info("Write to DISPCNT, Value: {:04X}h", mmu.lcd->regs.dispcnt);
+        },
+        0xFFF7, false
+    };
+    io_table[io_index(0x4000004)] = {
+        [](const MMU &mmu, uint32_t) -> uint16_t { return mmu.lcd->regs.dispstat; },
+        [](MMU &mmu, uint32_t, const uint16_t value, const uint16_t mask)
+        {
+            // The status flags are read-only
+            set_bits(mmu.lcd->regs.dispstat, value, mask & 0xFF38u);
+
+            mmu.console->info("Write to DISPSTAT, Value: {:04X}h", mmu.lcd->regs.dispstat);
+        },
+        0xFF3F, false
+    };
+    io_table[io_index(0x4000006)] = {
+        [](const MMU &mmu, uint32_t) -> uint16_t { return mmu.lcd->regs.vcount; },
+        nullptr,
+        0x00FF, false
+    };
+
+    for (uint32_t address = 0x4000008; address < 0x4000010; address += 2u)
     {
-        return wram_board[addr_masked % 0x40000u];
+        io_table[io_index(address)] = {
+            [](const MMU &mmu, const uint32_t address) -> uint16_t
+            {
+                return mmu.lcd->regs.bg[(address - 0x4000008u) >> 1u].bgcnt;
+            },
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                set_bits(mmu.lcd->regs.bg[(address - 0x4000008u) >> 1u].bgcnt, value, mask);
+            },
+            0xFFFF, false
+        };
     }
-    else if (in_range(addr_masked, 0x3000000, 0x4000000))
+
+    for (uint32_t address = 0x4000010; address < 0x4000020; address += 4u)
+    {
+        io_table[io_index(address)] = {
+            nullptr,
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                set_bits(mmu.lcd->regs.bg[(address - 0x4000010u) >> 2u].bghofs, value, mask);
+            },
+            0x01FF, false
+        };
+        io_table[io_index(address + 2u)] = {
+            nullptr,
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                set_bits(mmu.lcd->regs.bg[(address - 0x4000012u) >> 2u].bgvofs, value, mask);
+            },
+            0x01FF, false
+        };
+    }
+
+    // BG affine parameters, windows, mosaic and blending aren't emulated yet
+    for (uint32_t address = 0x4000020; address < 0x4000048; address += 2u)
+    {
+        io_table[io_index(address)] = write_only;
+    }
+
+    io_table[io_index(0x4000048)] = storage;
+    io_table[io_index(0x400004A)] = storage;
+    io_table[io_index(0x400004C)] = write_only;
+    io_table[io_index(0x4000050)] = storage;
+    io_table[io_index(0x4000052)] = storage;
+    io_table[io_index(0x4000054)] = write_only;
+
+    // Sound isn't emulated, the registers only hold their values
+    for (uint32_t address = 0x4000060; address < 0x40000A0; address += 2u)
+    {
+        io_table[io_index(address)] = storage;
+    }
+
+    for (uint32_t address = 0x40000A0; address < 0x40000A8; address += 2u)
+    {
+        io_table[io_index(address)] = write_only;
+    }
+
+    // DMA
+    for (uint32_t address = 0x40000B0; address < 0x40000E0; address += 12u)
+    {
+        size_t channel = (address - 0x40000B0u) / 12u;
+
+        io_table[io_index(address)] = {
+            nullptr,
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                size_t channel = (address - 0x40000B0u) / 12u;
+                uint32_t s_addr = mmu.dma->channels[channel].dmasad;
+
+                mmu.dma->set_s_addr(channel, (s_addr & ~(uint32_t)mask) | (value & mask));
+            },
+            0xFFFF, false
+        };
+        io_table[io_index(address + 2u)] = {
+            nullptr,
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                size_t channel = (address - 0x40000B2u) / 12u;
+                uint32_t s_addr = mmu.dma->channels[channel].dmasad;
+
+                mmu.dma->set_s_addr(channel, (s_addr & ~((uint32_t)mask << 16u)) | (uint32_t)(value & mask) << 16u);
+            },
+            (uint16_t)((channel == 0) ? 0x07FF : 0x0FFF), false
+        };
+        io_table[io_index(address + 4u)] = {
+            nullptr,
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                size_t channel = (address - 0x40000B4u) / 12u;
+                uint32_t d_addr = mmu.dma->channels[channel].dmadad;
+
+                mmu.dma->set_d_addr(channel, (d_addr & ~(uint32_t)mask) | (value & mask));
+            },
+            0xFFFF, false
+        };
+        io_table[io_index(address + 6u)] = {
+            nullptr,
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                size_t channel = (address - 0x40000B6u) / 12u;
+                uint32_t d_addr = mmu.dma->channels[channel].dmadad;
+
+                mmu.dma->set_d_addr(channel, (d_addr & ~((uint32_t)mask << 16u)) | (uint32_t)(value & mask) << 16u);
+            },
+            (uint16_t)((channel == 3) ? 0x0FFF : 0x07FF), false
+        };
+        io_table[io_index(address + 8u)] = {
+            nullptr,
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                size_t channel = (address - 0x40000B8u) / 12u;
+                uint16_t count = mmu.dma->channels[channel].control.dmacnt_l;
+
+                set_bits(count, value, mask);
+
+                mmu.dma->set_count(channel, count);
+            },
+            (uint16_t)((channel == 3) ? 0xFFFF : 0x3FFF), false
+        };
+        io_table[io_index(address + 10u)] = {
+            [](const MMU &mmu, const uint32_t address) -> uint16_t
+            {
+                return mmu.dma->channels[(address - 0x40000BAu) / 12u].control.dmacnt_h;
+            },
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                size_t channel = (address - 0x40000BAu) / 12u;
+                uint16_t control = mmu.dma->channels[channel].control.dmacnt_h;
+
+                set_bits(control, value, mask);
+
+                // DMA1 and DMA2 are only used for sound, which isn't emulated
+                if (channel == 1 || channel == 2)
+                {
+                    control &= 0x7FFFu;
+                }
+
+                mmu.dma->set_control(channel, control);
+            },
+            (uint16_t)((channel == 3) ? 0xFFE0 : 0xF7E0), true
+        };
+    }
+
+    // Timers
+    for (uint32_t address = 0x4000100; address < 0x4000110; address += 4u)
     {
-        return wram_chip[addr_masked % 0x8000u];
+        io_table[io_index(address)] = {
+            [](const MMU &mmu, const uint32_t address) -> uint16_t
+            {
+                mmu.timer_read = true;
+
+                return mmu.timer->get_counter((address - 0x4000100u) >> 2u);
+            },
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                size_t timer = (address - 0x4000100u) >> 2u;
+                uint16_t reload = mmu.timer->get_reload(timer);
+
+                set_bits(reload, value, mask);
+
+                mmu.timer->set_reload(timer, reload);
+            },
+            0xFFFF, false
+        };
+        io_table[io_index(address + 2u)] = {
+            [](const MMU &mmu, const uint32_t address) -> uint16_t
+            {
+                return mmu.timer->get_control((address - 0x4000102u) >> 2u);
+            },
+            [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+            {
+                size_t timer = (address - 0x4000102u) >> 2u;
+                uint16_t control = mmu.timer->get_control(timer);
+
+                set_bits(control, value, mask);
+
+                mmu.timer->set_control(timer, control);
+            },
+            0x00C7, true
+        };
     }
-    else if (in_range(addr_masked, 0x04000000, 0x4000800))
+
+    // Serial communication isn't emulated, SIOCNT always reports a finished transfer
+    for (uint32_t address = 0x4000120; address < 0x4000130; address += 2u)
     {
-        switch (addr_masked)
+        io_table[io_index(address)] = storage;
+    }
+
+    io_table[io_index(0x4000128)].read = [](const MMU &, uint32_t) -> uint16_t { return 0x80; };
+
+    for (uint32_t address = 0x4000134; address < 0x4000160; address += 2u)
+    {
+        io_table[io_index(address)] = storage;
+    }
+
+    // Keypad
+    io_table[io_index(0x4000130)] = {
+        [](const MMU &mmu, uint32_t) -> uint16_t { return mmu.gba->get_input(); },
+        nullptr,
+        0x03FF, true
+    };
+    io_table[io_index(0x4000132)] = storage;
+    io_table[io_index(0x4000132)].width_mask = 0xC3FF;
+
+    // Interrupts and system control
+    io_table[io_index(0x4000200)] = {
+        [](const MMU &mmu, uint32_t) -> uint16_t { return mmu.interrupts->get_enable(); },
+        [](MMU &mmu, uint32_t, const uint16_t value, const uint16_t mask)
         {
-            case 0x4000006:
-                return lcd->regs.vcount & 0xFFu;
-            default:
-                console->warn("Unhandled read8 from IO port! Address: {:08X}h", addr_masked);
-                return 0;
+            uint16_t enable = mmu.interrupts->get_enable();
+
+            set_bits(enable, value, mask);
+
+            mmu.console->info("Write to Interrupt Enable, Value: {:04X}h", enable);
+
+            mmu.interrupts->set_enable(enable);
+        },
+        0x3FFF, true
+    };
+    io_table[io_index(0x4000202)] = {
+        [](const MMU &mmu, uint32_t) -> uint16_t { return mmu.interrupts->get_request_flags(); },
+        [](MMU &mmu, uint32_t, const uint16_t value, const uint16_t mask)
+        {
+            // Writing 1 acknowledges an interrupt
+            mmu.interrupts->acknowledge(value & mask);
+
+            mmu.console->info("Write to Interrupt Flags, Value: {:04X}h", value & mask);
+        },
+        0x3FFF, true
+    };
+    io_table[io_index(0x4000204)] = {
+        [](const MMU &mmu, uint32_t) -> uint16_t { return mmu.waitcnt; },
+        [](MMU &mmu, uint32_t, const uint16_t value, const uint16_t mask)
+        {
+            uint16_t waitcnt = mmu.waitcnt;
+
+            set_bits(waitcnt, value, mask);
+
+            mmu.console->info("Write to WAITCNT, Value: {:04X}h", waitcnt);
+
+            mmu.set_waitcnt(waitcnt);
+        },
+        0x5FFF, false
+    };
+    io_table[io_index(0x4000208)] = {
+        [](const MMU &mmu, uint32_t) -> uint16_t { return mmu.interrupts->get_master_enable(); },
+        [](MMU &mmu, uint32_t, const uint16_t value, const uint16_t mask)
+        {
+            uint16_t master_enable = mmu.interrupts->get_master_enable();
+
+            set_bits(master_enable, value, mask);
+
+            mmu.console->info("Write to Interrupt Master Enable, Value: {:04X}h", master_enable);
+
+            mmu.interrupts->set_master_enable(master_enable);
+        },
+        0x0001, true
+    };
+    // POSTFLG, HALTCNT is write-only and halts (bit 7 clear) or stops (bit 7 set) the CPU
+    io_table[io_index(0x4000300)] = {
+        storage.read,
+        [](MMU &mmu, const uint32_t address, const uint16_t value, const uint16_t mask)
+        {
+            set_bits(mmu.io_storage[io_index(address)], value, mask & 0xFFu);
+
+            if ((mask & 0xFF00u) != 0)
+            {
+                mmu.cpu->halt((value & 0x8000u) != 0);
+            }
+        },
+        0xFFFF, true
+    };
+}
+
+uint16_t MMU::read_io(const uint32_t address) const
+{
+    const IO_Register &io_register = io_table[io_index(address)];
+
+    if (io_register.read == nullptr)
+    {
+        if (io_register.width_mask == 0)
+        {
+            console->warn("Unhandled read from IO port! Address: {:08X}h", address);
         }
+
+        return 0;
     }
-    else if (in_range(addr_masked, 0x6000000, 0x7000000))
+
+    return io_register.read(*this, address) & io_register.width_mask;
+}
+
+void MMU::write_io(const uint32_t address, const uint16_t value, const uint16_t mask)
+{
+    const IO_Register &io_register = io_table[io_index(address)];
+
+    if (io_register.write == nullptr)
     {
-        return vram[addr_masked % 0x18000u];
+        if (io_register.width_mask == 0)
+        {
+            console->warn("Unhandled write to IO port! Address: {:08X}h, value: {:04X}h", address, value & mask);
+        }
+
+        return;
     }
-    else if (in_range(addr_masked, 0x08000000, 0x0E000000))
+
+    io_register.write(*this, address, value, mask & io_register.width_mask);
+}
+
+void MMU::fill_page_tables()
+{
+    for (size_t region = 0; region < 16; region++)
+    {
+        map_region(region, nullptr, 0, 0);
+    }
+
+    map_region(0x0, bios.data(), bios.size(), 0xFFFFFFu);
+    map_region(0x2, wram_board.data(), wram_board.size(), 0x3FFFFu);
+    map_region(0x3, wram_chip.data(), wram_chip.size(), 0x7FFFu);
+    map_region(0x5, palette_ram.data(), palette_ram.size(), 0x3FFu);
+    map_region(0x6, vram.data(), vram.size(), 0x1FFFFu);
+    map_region(0x7, oam.data(), oam.size(), 0x3FFu);
+
+    // The last 32 KiB of the VRAM region mirror the OBJ tiles
+    read_regions[0x6].pages[6] = vram.data() + 0x10000u;
+    read_regions[0x6].pages[7] = vram.data() + 0x10000u + PAGE_SIZE;
+
+    // Game Pak ROM is mirrored in all three waitstate regions, a partial page at the end takes the slow path
+    for (size_t region = 0x8; region < 0xE; region++)
+    {
+        size_t base = (region & 1u) << 24u;
+
+        if (cart->data.size() > base)
+        {
+            map_region(region, cart->data.data() + base, cart->data.size() - base, 0xFFFFFFu);
+        }
+    }
+
+    for (size_t region = 0x2; region < 0x8; region++)
+    {
+        if (region != 0x4)
+        {
+            write_regions[region] = read_regions[region];
+        }
+    }
+
+    // Byte writes to palette RAM, VRAM and OAM don't simply store a byte
+    write8_regions[0x2] = read_regions[0x2];
+    write8_regions[0x3] = read_regions[0x3];
+}
+
+void MMU::set_vram_tracking(const bool enabled)
+{
+    vram_dirty.set();
+
+    if (enabled)
+    {
+        std::fill(write_regions[0x6].pages.begin(), write_regions[0x6].pages.end(), nullptr);
+    }
+    else
+    {
+        write_regions[0x6] = read_regions[0x6];
+    }
+}
+
+void MMU::map_region(const size_t region, uint8_t *const data, const size_t size, const uint32_t mask)
+{
+    size_t page_size = std::min<size_t>(PAGE_SIZE, (size_t)mask + 1u);
+
+    read_regions[region].mask = mask;
+    read_regions[region].pages.assign((mask >> PAGE_SHIFT) + 1u, nullptr);
+
+    for (size_t page = 0; page < read_regions[region].pages.size(); page++)
+    {
+        if ((page << PAGE_SHIFT) + page_size <= size)
+        {
+            read_regions[region].pages[page] = data + (page << PAGE_SHIFT);
+        }
+    }
+
+    write_regions[region]  = { mask, std::vector<uint8_t *>(read_regions[region].pages.size(), nullptr) };
+    write8_regions[region] = write_regions[region];
+}
+
+void MMU::map_wram_page(const uint32_t address, const bool writable)
+{
+    size_t region = (address >> 24u) & 0xFu;
+    size_t page   = (address & read_regions[region].mask) >> PAGE_SHIFT;
+    uint8_t *data = (writable) ? read_regions[region].pages[page] : nullptr;
+
+    write_regions[region].pages[page]  = data;
+    write8_regions[region].pages[page] = data;
+}
+
+uint8_t *MMU::get_host_pointer(const std::array<Memory_Region, 16> &regions, const uint32_t address) const
+{
+    const Memory_Region &region = regions[(address >> 24u) & 0xFu];
+    uint32_t offset = address & region.mask;
+    uint8_t *page   = region.pages[offset >> PAGE_SHIFT];
+
+    return (page != nullptr) ? page + (offset & PAGE_MASK) : nullptr;
+}
+
+// Bytes from address to the end of its page or mirror, whichever comes first
+uint32_t MMU::get_host_span(const std::array<Memory_Region, 16> &regions, const uint32_t address) const
+{
+    const Memory_Region &region = regions[(address >> 24u) & 0xFu];
+    uint32_t offset = address & region.mask;
+
+    return std::min(PAGE_SIZE - (offset & PAGE_MASK), region.mask + 1u - offset);
+}
+
+size_t MMU::get_code_page(const uint32_t address) const
+{
+    if (((address >> 24u) & 0xFu) == 0x2)
+    {
+        return (address & 0x3FFFFu) >> CODE_PAGE_SHIFT;
+    }
+
+    return 0x400u + ((address & 0x7FFFu) >> CODE_PAGE_SHIFT);
+}
+
+void MMU::set_code_page(const uint32_t address)
+{
+    code_bitmap.set(get_code_page(address));
+
+    map_wram_page(address, false);
+}
+
+void MMU::clear_code_pages()
+{
+    code_bitmap.reset();
+
+    write_regions[0x2]  = read_regions[0x2];
+    write_regions[0x3]  = read_regions[0x3];
+    write8_regions[0x2] = read_regions[0x2];
+    write8_regions[0x3] = read_regions[0x3];
+}
+
+void MMU::check_code_write(const uint32_t address)
+{
+    uint32_t offset = address & read_regions[(address >> 24u) & 0xFu].mask;
+    size_t page     = get_code_page(address);
+
+    if (code_bitmap.test(page))
+    {
+        code_bitmap.reset(page);
+        cpu->invalidate_blocks((address & 0x0F000000u) | (offset & ~CODE_PAGE_MASK));
+    }
+
+    // Map the 16 KiB page for fast writes again once it holds no more code
+    size_t first_page = get_code_page(address & ~PAGE_MASK);
+
+    for (size_t i = first_page; i < first_page + (PAGE_SIZE >> CODE_PAGE_SHIFT); i++)
     {
-        if ((addr_masked % 0x2000000) >= cart->cart_bounds)
+        if (code_bitmap.test(i))
         {
-            console->error("Read out of bounds! Address: {:08X}h, ROM size: {:08X}h",
-                           addr_masked, cart->cart_bounds);
+            return;
+        }
+    }
+
+    map_wram_page(address, true);
+}
+
+uint8_t MMU::read8(const uint32_t address) const
+{
+    PROFILE_SAMPLED_SCOPE(Profile_MMU);
 
-            throw std::runtime_error("Read out of bounds!");
+    const uint8_t *host = get_host_pointer(read_regions, address);
+
+    if (host != nullptr)
+    {
+        return *host;
+    }
+
+    uint32_t addr_masked = address & 0x0FFFFFFFu;
+
+    if (in_range(addr_masked, 0x4000000, 0x4000400))
+    {
+        return read_io(addr_masked & ~1u) >> ((addr_masked & 1u) * 8u);
+    }
+    else if (in_range(addr_masked, 0x08000000, 0x0E000000))
+    {
+        if ((addr_masked % 0x2000000) >= cart->data.size())
+        {
+            return Cartridge::get_open_bus(addr_masked) >> ((addr_masked & 1u) * 8u);
         }
 
         return cart->data[addr_masked % 0x2000000];
@@ -116,73 +679,26 @@ uint8_t MMU::read8(const uint32_t address) const
 
 uint16_t MMU::read16(const uint32_t address) const
 {
-    uint32_t addr_masked = address & 0x0FFFFFFFu;
+    PROFILE_SAMPLED_SCOPE(Profile_MMU);
 
-    if (in_range(addr_masked, 0, 0x4000))
-    {
-        return *(uint16_t*)(bios.data() + addr_masked);
-    }
-    else if (in_range(addr_masked, 0x2000000, 0x3000000))
-    {
-        return *(uint16_t*)(wram_board.data() + (addr_masked % 0x40000u));
-    }
-    else if (in_range(addr_masked, 0x3000000, 0x4000000))
-    {
-        return *(uint16_t*)(wram_chip.data() + (addr_masked % 0x8000u));
-    }
-    else if (in_range(addr_masked, 0x04000000, 0x4000800))
-    {
-        switch (addr_masked)
-        {
-            case 0x4000000:
-                return lcd->regs.dispcnt;
-            case 0x4000004:
-                return lcd->regs.dispstat;
-            case 0x4000006:
-                return lcd->regs.vcount;
-            case 0x4000088:
-                return sound_bias;
-            case 0x4000100:
-                return timer->get_counter(0);
-            case 0x4000104:
-                return timer->get_counter(1);
-            case 0x4000108:
-                return timer->get_counter(2);
-            case 0x400010C:
-                return timer->get_counter(3);
-            case 0x4000128:
-                return 0x80;
-            case 0x4000130:
-                return gba->get_input();
-            case 0x4000200:
-                return interrupt_enable;
-            case 0x4000202:
-                return interrupt_request_flags;
-            case 0x4000208:
-                return interrupt_master_enable;
-            default:
-                console->warn("Unhandled read16 from IO port! Address: {:08X}h", addr_masked);
-                return 0;
-        }
-    }
-    else if (in_range(addr_masked, 0x5000000, 0x6000000))
+    const uint8_t *host = get_host_pointer(read_regions, address);
+
+    if (host != nullptr)
     {
-        return *(uint16_t*)(palette_ram.data() + (addr_masked % 0x400u));
+        return *(uint16_t*)host;
     }
-    else if (in_range(addr_masked, 0x6000000, 0x7000000))
+
+    uint32_t addr_masked = address & 0x0FFFFFFFu;
+
+    if (in_range(addr_masked, 0x4000000, 0x4000400))
     {
-        return *(uint16_t*)(vram.data() + (addr_masked % 0x18000u));
+        return read_io(addr_masked & ~1u);
     }
     else if (in_range(addr_masked, 0x08000000, 0x0E000000))
     {
-        if ((addr_masked % 0x2000000) >= cart->cart_bounds)
+        if ((addr_masked % 0x2000000) >= cart->data.size())
         {
-            console->error("Read out of bounds! Address: {:08X}h, ROM size: {:08X}h",
-                           addr_masked, cart->cart_bounds);
-
-            return 0xFFFF;
-
-            throw std::runtime_error("Read out of bounds!");
+            return Cartridge::get_open_bus(addr_masked);
         }
 
         return *(uint16_t *)(cart->data.data() + (addr_masked % 0x2000000));
@@ -197,57 +713,27 @@ uint16_t MMU::read16(const uint32_t address) const
 
 uint32_t MMU::read32(const uint32_t address) const
 {
-    uint32_t addr_masked = address & 0x0FFFFFFFu;
+    PROFILE_SAMPLED_SCOPE(Profile_MMU);
 
-    if (in_range(addr_masked, 0, 0x4000))
-    {
-        return *(uint32_t*)(bios.data() + addr_masked);
-    }
-    else if (in_range(addr_masked, 0x2000000, 0x3000000))
-    {
-        return *(uint32_t*)(wram_board.data() + (addr_masked % 0x40000u));
-    }
-    else if (in_range(addr_masked, 0x3000000, 0x4000000))
-    {
-        return *(uint32_t*)(wram_chip.data() + (addr_masked % 0x8000u));
-    }
-    else if (in_range(addr_masked, 0x04000000, 0x4000800))
-    {
-        switch (addr_masked)
-        {
-            case 0x4000004:
-                return lcd->regs.dispstat | (uint32_t)lcd->regs.vcount << 16u;
-            case 0x40000DC:
-                return (uint32_t)dma->channels[3].control.dmacnt_h << 16u;
-            case 0x4000130:
-                return gba->get_input() | 0xFFFF0000u;
-            case 0x4000200:
-                return interrupt_enable | (uint32_t)(interrupt_request_flags << 16u);
-            default:
-                console->warn("Unhandled read32 from IO port! Address: {:08X}h", addr_masked);
-                return 0;
-        }
-    }
-    else if (in_range(addr_masked, 0x5000000, 0x6000000))
-    {
-        return *(uint32_t*)(palette_ram.data() + (addr_masked % 0x400u));
-    }
-    else if (in_range(addr_masked, 0x6000000, 0x7000000))
+    const uint8_t *host = get_host_pointer(read_regions, address);
+
+    if (host != nullptr)
     {
-        return *(uint32_t*)(vram.data() + (addr_masked % 0x18000u));
+        return *(uint32_t*)host;
     }
-    else if (in_range(addr_masked, 0x7000000, 0x8000000))
+
+    uint32_t addr_masked = address & 0x0FFFFFFFu;
+
+    if (in_range(addr_masked, 0x4000000, 0x4000400))
     {
-        return *(uint32_t*)(oam.data() + (addr_masked % 0x400u));
+        return read_io(addr_masked & ~3u) | (uint32_t)read_io((addr_masked & ~3u) + 2u) << 16u;
     }
     else if (in_range(addr_masked, 0x08000000, 0x0E000000))
     {
-        if ((addr_masked % 0x2000000) >= cart->cart_bounds)
+        if ((addr_masked % 0x2000000) >= cart->data.size())
         {
-            console->error("Read out of bounds! Address: {:08X}h, ROM size: {:08X}h",
-                    addr_masked, cart->cart_bounds);
-
-            throw std::runtime_error("Read out of bounds!");
+            return Cartridge::get_open_bus(addr_masked & ~3u) |
+                   (uint32_t)Cartridge::get_open_bus((addr_masked & ~3u) + 2u) << 16u;
         }
 
         return *(uint32_t *)(cart->data.data() + (addr_masked % 0x2000000));
@@ -262,6 +748,16 @@ uint32_t MMU::read32(const uint32_t address) const
 
 void MMU::write8(const uint8_t value, const uint32_t address)
 {
+    PROFILE_SAMPLED_SCOPE(Profile_MMU);
+
+    uint8_t *host = get_host_pointer(write8_regions, address);
+
+    if (host != nullptr)
+    {
+        *host = value;
+        return;
+    }
+
     uint32_t addr_masked = address & 0x0FFFFFFFu;
 
     if (addr_masked < 0x4000)
@@ -271,36 +767,48 @@ void MMU::write8(const uint8_t value, const uint32_t address)
     if (in_range(addr_masked, 0x2000000, 0x3000000))
     {
         wram_board[addr_masked % 0x40000u] = value;
+        check_code_write(addr_masked);
         return;
     }
     else if (in_range(addr_masked, 0x3000000, 0x4000000))
     {
         wram_chip[addr_masked % 0x8000u] = value;
+        check_code_write(addr_masked);
+        return;
+    }
+    else if (in_range(addr_masked, 0x4000000, 0x4000400))
+    {
+        write_io(addr_masked & ~1u, value * 0x101u, 0xFFu << ((addr_masked & 1u) * 8u));
+        return;
+    }
+    else if (in_range(addr_masked, 0x5000000, 0x6000000))
+    {
+        // Byte writes to palette RAM store the value to both bytes of the halfword
+        *(uint16_t*)(palette_ram.data() + (addr_masked & 0x3FEu)) = value * 0x101u;
         return;
     }
-    else if (in_range(addr_masked, 0x04000000, 0x4000800))
+    else if (in_range(addr_masked, 0x6000000, 0x7000000))
     {
-        switch (addr_masked)
+        uint32_t offset = addr_masked & 0x1FFFEu;
+        uint32_t obj_start = ((lcd->regs.dispcnt & 7u) >= 3) ? 0x14000u : 0x10000u;
+
+        if (offset >= 0x18000u)
         {
-            case 0x4000208:
-                //console->info("Write to Interrupt Master Enable, Value: {:02X}h", value);
+            offset -= 0x8000u;
+        }
 
-                interrupt_master_enable = value;
+        // Byte writes to BG VRAM behave like palette RAM, byte writes to OBJ VRAM are ignored
+        if (offset < obj_start)
+        {
+            *(uint16_t*)(vram.data() + offset) = value * 0x101u;
 
-                /*if (((uint16_t)value & 1u) != 0)
-                {
-                    console->critical("IME: Interrupts enabled!");
-                }
-                else
-                {
-                    console->critical("IME: Interrupts disabled!");
-                }*/
-                break;
-            default:
-                //console->warn("Unhandled write8 to IO port! Address: {:08X}h, value: {:02X}h", addr_masked, value);
-                break;
+            vram_dirty.set(offset >> 10u);
         }
-
+        return;
+    }
+    else if (in_range(addr_masked, 0x7000000, 0x8000000))
+    {
+        // Byte writes to OAM are ignored
         return;
     }
     else if (in_range(addr_masked, 0x08000000, 0x0E000000))
@@ -321,6 +829,16 @@ void MMU::write8(const uint8_t value, const uint32_t address)
 
 void MMU::write16(const uint16_t value, const uint32_t address)
 {
+    PROFILE_SAMPLED_SCOPE(Profile_MMU);
+
+    uint8_t *host = get_host_pointer(write_regions, address);
+
+    if (host != nullptr)
+    {
+        *(uint16_t*)host = value;
+        return;
+    }
+
     uint32_t addr_masked = address & 0x0FFFFFFFu;
 
     if (in_range(addr_masked, 0, 0x4000))
@@ -330,141 +848,32 @@ void MMU::write16(const uint16_t value, const uint32_t address)
     else if (in_range(addr_masked, 0x2000000, 0x3000000))
     {
         *(uint16_t*)(wram_board.data() + (addr_masked % 0x40000u)) = value;
+        check_code_write(addr_masked);
         return;
     }
     else if (in_range(addr_masked, 0x3000000, 0x4000000))
     {
         *(uint16_t*)(wram_chip.data() + (addr_masked % 0x8000u)) = value;
+        check_code_write(addr_masked);
         return;
     }
-    else if (in_range(addr_masked, 0x04000000, 0x4000800))
+    else if (in_range(addr_masked, 0x4000000, 0x4000400))
     {
-        switch (addr_masked)
-        {
-            case 0x4000000:
-                console->info("Write to DISPCNT, Value: {:04X}h", value);
-
-                lcd->regs.dispcnt = value;
-                break;
-            case 0x4000004:
-                console->info("Write to DISPSTAT, Value: {:04X}h", value);
-
-                lcd->regs.dispstat = (lcd->regs.dispstat & 0x0007u) | (value & 0xFFF8u);
-                break;
-            case 0x4000008:
-                //console->info("Write to BG0CNT, Value: {:04X}h", value);
-
-                lcd->regs.bg[0].bgcnt = value;
-                break;
-            case 0x400000A:
-                lcd->regs.bg[1].bgcnt = value;
-                break;
-            case 0x400000C:
-                lcd->regs.bg[2].bgcnt = value;
-                break;
-            case 0x400000E:
-                lcd->regs.bg[3].bgcnt = value;
-                break;
-            case 0x4000010:
-                lcd->regs.bg[0].bghofs = value;
-                break;
-            case 0x4000012:
-                lcd->regs.bg[0].bgvofs = value;
-                break;
-            case 0x4000014:
-                lcd->regs.bg[1].bghofs = value;
-                break;
-            case 0x4000016:
-                lcd->regs.bg[1].bgvofs = value;
-                break;
-            case 0x4000018:
-                lcd->regs.bg[2].bghofs = value;
-                break;
-            case 0x400001A:
-                lcd->regs.bg[2].bgvofs = value;
-                break;
-            case 0x400001C:
-                lcd->regs.bg[3].bghofs = value;
-                break;
-            case 0x400001E:
-                lcd->regs.bg[3].bgvofs = value;
-                break;
-            case 0x4000088:
-                sound_bias = value;
-                break;
-            case 0x40000DC:
-                dma->set_count(3, value);
-                break;
-            case 0x4000100:
-                timer->set_reload(0, value);
-                break;
-            case 0x4000102:
-                timer->set_control(0, value);
-                break;
-            case 0x4000104:
-                timer->set_reload(1, value);
-                break;
-            case 0x4000106:
-                timer->set_control(1, value);
-                break;
-            case 0x4000108:
-                timer->set_reload(2, value);
-                break;
-            case 0x400010A:
-                timer->set_control(2, value);
-                break;
-            case 0x400010C:
-                timer->set_reload(3, value);
-                break;
-            case 0x400010E:
-                timer->set_control(3, value);
-                break;
-            case 0x4000200:
-                console->info("Write to Interrupt Enable, Value: {:04X}h", value);
-
-                interrupt_enable = value;
-                break;
-            case 0x4000202:
-                console->info("Write to Interrupt Flags, Value: {:04X}h", value);
-
-                interrupt_request_flags &= (uint16_t)~value;
-                break;
-            case 0x4000208:
-                console->info("Write to Interrupt Master Enable, Value: {:04X}h", value);
-
-                interrupt_master_enable = value;
-
-                if (((uint16_t)value & 1u) != 0)
-                {
-                    console->critical("IME: Interrupts enabled!");
-                }
-                else
-                {
-                    console->critical("IME: Interrupts disabled!");
-                }
-                break;
-            default:
-                console->warn("Unhandled write16 to IO port! Address: {:08X}h, value: {:04X}h", addr_masked, value);
-                break;
-        }
-
-        return;
-    }
-    else if (in_range(addr_masked, 0x5000000, 0x6000000))
-    {
-        //console->info("Write to palette RAM, Address: {:08X}h, value: {:04X}h", addr_masked, value);
-
-        *(uint16_t*)(palette_ram.data() + (addr_masked % 0x400u)) = value;
+        write_io(addr_masked & ~1u, value, 0xFFFF);
         return;
     }
     else if (in_range(addr_masked, 0x6000000, 0x7000000))
     {
-        *(uint16_t*)(vram.data() + (addr_masked % 0x18000u)) = value;
-        return;
-    }
-    else if (in_range(addr_masked, 0x7000000, 0x8000000))
-    {
-        *(uint16_t*)(oam.data() + (addr_masked % 0x400u)) = value;
+        uint32_t offset = addr_masked & 0x1FFFEu;
+
+        if (offset >= 0x18000u)
+        {
+            offset -= 0x8000u;
+        }
+
+        *(uint16_t*)(vram.data() + offset) = value;
+
+        vram_dirty.set(offset >> 10u);
         return;
     }
     else if (in_range(addr_masked, 0x08000000, 0x0E000000))
@@ -481,6 +890,16 @@ void MMU::write16(const uint16_t value, const uint32_t address)
 
 void MMU::write32(const uint32_t value, const uint32_t address)
 {
+    PROFILE_SAMPLED_SCOPE(Profile_MMU);
+
+    uint8_t *host = get_host_pointer(write_regions, address);
+
+    if (host != nullptr)
+    {
+        *(uint32_t*)host = value;
+        return;
+    }
+
     uint32_t addr_masked = address & 0x0FFFFFFFu;
 
     if (addr_masked < 0x4000)
@@ -490,89 +909,33 @@ void MMU::write32(const uint32_t value, const uint32_t address)
     if (in_range(addr_masked, 0x2000000, 0x3000000))
     {
         *(uint32_t*)(wram_board.data() + (addr_masked % 0x40000u)) = value;
+        check_code_write(addr_masked);
         return;
     }
     else if (in_range(addr_masked, 0x3000000, 0x4000000))
     {
         *(uint32_t*)(wram_chip.data() + (addr_masked % 0x8000u)) = value;
+        check_code_write(addr_masked);
         return;
     }
-    else if (in_range(addr_masked, 0x04000000, 0x4000800))
+    else if (in_range(addr_masked, 0x4000000, 0x4000400))
     {
-        switch (addr_masked)
-        {
-            case 0x4000000:
-                console->info("Write to DISPCNT, Value: {:04X}h", (uint16_t)value);
-
-                lcd->regs.dispcnt = (uint16_t)value;
-                break;
-            case 0x40000D4:
-                dma->set_s_addr(3, value);
-                break;
-            case 0x40000D8:
-                dma->set_d_addr(3, value);
-                break;
-            case 0x40000DC:
-                dma->set_count(3, value);
-                dma->set_control(3, value >> 16u);
-                break;
-            case 0x4000100:
-                timer->set_reload(0, value);
-                timer->set_control(0, value >> 16u);
-                break;
-            case 0x4000104:
-                timer->set_reload(1, value);
-                timer->set_control(1, value >> 16u);
-                break;
-            case 0x4000108:
-                timer->set_reload(2, value);
-                timer->set_control(2, value >> 16u);
-                break;
-            case 0x400010C:
-                timer->set_reload(3, value);
-                timer->set_control(3, value >> 16u);
-                break;
-            case 0x4000200:
-                console->info("Write to IE/IF, Value: {:08X}h", value);
-
-                interrupt_enable = value;
-                interrupt_request_flags &= (uint16_t)~(value >> 16u);
-                break;
-            case 0x4000208:
-                console->info("Write to Interrupt Master Enable, Value: {:04X}h", (uint16_t)value);
-
-                interrupt_master_enable = (uint16_t)value;
-
-                if (((uint16_t)value & 1u) != 0)
-                {
-                    console->critical("IME: Interrupts enabled!");
-                }
-                else
-                {
-                    console->critical("IME: Interrupts disabled!");
-                }
-                break;
-            default:
-                console->warn("Unhandled write32 to IO port! Address: {:08X}h, value: {:08X}h", addr_masked, value);
-                break;
-        }
-        return;
-    }
-    else if (in_range(addr_masked, 0x5000000, 0x6000000))
-    {
-        //console->info("Write to palette RAM, Address: {:08X}h, value: {:08X}h", addr_masked, value);
-
-        *(uint32_t*)(palette_ram.data() + (addr_masked % 0x400u)) = value;
+        write_io(addr_masked & ~3u, value, 0xFFFF);
+        write_io((addr_masked & ~3u) + 2u, value >> 16u, 0xFFFF);
         return;
     }
     else if (in_range(addr_masked, 0x6000000, 0x7000000))
     {
-        *(uint32_t*)(vram.data() + (addr_masked % 0x18000u)) = value;
-        return;
-    }
-    else if (in_range(addr_masked, 0x7000000, 0x8000000))
-    {
-        *(uint32_t*)(oam.data() + (addr_masked % 0x400u)) = value;
+        uint32_t offset = addr_masked & 0x1FFFCu;
+
+        if (offset >= 0x18000u)
+        {
+            offset -= 0x8000u;
+        }
+
+        *(uint32_t*)(vram.data() + offset) = value;
+
+        vram_dirty.set(offset >> 10u);
         return;
     }
     else if (in_range(addr_masked, 0x08000000, 0x0E000000))
@@ -588,3 +951,146 @@ void MMU::write32(const uint32_t value, const uint32_t address)
 
     throw std::runtime_error("Unhandled write32!");
 }
+
+const uint8_t *MMU::get_read_block(const uint32_t address, const uint32_t size) const
+{
+    const uint8_t *host = get_host_pointer(read_regions, address);
+
+    return (host != nullptr && get_host_span(read_regions, address) >= size) ? host : nullptr;
+}
+
+uint8_t *MMU::get_write_block(const uint32_t address, const uint32_t size)
+{
+    uint8_t *host = get_host_pointer(write_regions, address);
+
+    return (host != nullptr && get_host_span(write_regions, address) >= size) ? host : nullptr;
+}
+
+void MMU::copy_block(uint32_t destination, uint32_t source, uint32_t count, const bool word)
+{
+    uint32_t unit = (word) ? 4u : 2u;
+
+    // Overlapping forward copies repeat the start of the source, keep the unit by unit order for them.
+    // Backward copies give the same result as memmove, which is also fine when the ranges overlap
+    bool overlap = destination > source && destination - source < count * unit;
+
+    while (count > 0)
+    {
+        uint8_t *dst_host = get_host_pointer(write_regions, destination);
+        const uint8_t *src_host = get_host_pointer(read_regions, source);
+
+        if (!overlap && dst_host != nullptr && src_host != nullptr)
+        {
+            uint32_t span = std::min(get_host_span(write_regions, destination), get_host_span(read_regions, source));
+            uint32_t run  = std::min(count, span / unit);
+
+            if (run > 0)
+            {
+                std::memmove(dst_host, src_host, run * unit);
+
+                destination += run * unit;
+                source += run * unit;
+                count  -= run;
+                continue;
+            }
+        }
+
+        if (word)
+        {
+            write32(read32(source), destination);
+        }
+        else
+        {
+            write16(read16(source), destination);
+        }
+
+        destination += unit;
+        source += unit;
+        --count;
+    }
+}
+
+void MMU::fill_block(uint32_t destination, const uint32_t value, uint32_t count, const bool word)
+{
+    uint32_t unit = (word) ? 4u : 2u;
+
+    while (count > 0)
+    {
+        uint8_t *dst_host = get_host_pointer(write_regions, destination);
+
+        if (dst_host != nullptr)
+        {
+            uint32_t run = std::min(count, get_host_span(write_regions, destination) / unit);
+
+            if (run > 0)
+            {
+                if (word)
+                {
+                    std::fill_n((uint32_t*)dst_host, run, value);
+                }
+                else
+                {
+                    std::fill_n((uint16_t*)dst_host, run, (uint16_t)value);
+                }
+
+                destination += run * unit;
+                count -= run;
+                continue;
+            }
+        }
+
+        if (word)
+        {
+            write32(value, destination);
+        }
+        else
+        {
+            write16(value, destination);
+        }
+
+        destination += unit;
+        --count;
+    }
+}
+
+void MMU::write_block(uint32_t destination, const uint8_t *data, uint32_t size, const uint32_t unit)
+{
+    // Byte writes are only mapped for WRAM, everything else has to see them one by one
+    const std::array<Memory_Region, 16> &regions = (unit == 1) ? write8_regions : write_regions;
+
+    destination &= ~(unit - 1u);
+
+    while (size > 0)
+    {
+        uint8_t *dst_host = get_host_pointer(regions, destination);
+
+        if (dst_host != nullptr)
+        {
+            uint32_t run = std::min(size, get_host_span(regions, destination));
+
+            std::memcpy(dst_host, data, run);
+
+            destination += run;
+            data += run;
+            size -= run;
+            continue;
+        }
+
+        switch (unit)
+        {
+            case 1:
+                write8(*data, destination);
+                break;
+            case 2:
+                write16(*(const uint16_t*)data, destination);
+                break;
+            default:
+                write32(*(const uint32_t*)data, destination);
+                break;
+        }
+
+        destination += unit;
+        data += unit;
+        size -= unit;
+    }
+}
@@ -21,26 +21,41 @@
 #define AMAZINGLY_ADVANCED_MMU_H
 
 
+#include "io_registers.h"
+#include "memory_regions.h"
+
 #include "../utils/file_utils.h"
 
+#include <array>
+#include <bitset>
 #include <memory>
 #include <vector>
 
 class Cartridge;
+class CPU;
 class DMA;
 class GBA;
+class Interrupts;
+class JIT;
 class LCD;
+class Scheduler;
 class Timer;
 
 class MMU
 {
+    friend CPU;
     friend DMA;
     friend GBA;
+    friend JIT;
     friend LCD;
     friend Timer;
 private:
     std::shared_ptr<spdlog::logger> console;
 
+    CPU *cpu;
+
+    std::unique_ptr<Scheduler> scheduler;
+    std::unique_ptr<Interrupts> interrupts;
     std::unique_ptr<Cartridge> cart;
     std::unique_ptr<DMA>  dma;
     std::unique_ptr<LCD>  lcd;
@@ -52,16 +67,73 @@ private:
     std::vector<uint8_t> palette_ram;
     std::vector<uint8_t> vram;
     std::vector<uint8_t> oam;
+
+    // Page tables for fast accesses, byte writes are only mapped for WRAM
+    std::array<Memory_Region, 16> read_regions;
+    std::array<Memory_Region, 16> write_regions;
+    std::array<Memory_Region, 16> write8_regions;
+
+    // I/O register descriptors for 0x4000000-0x40003FF, one per halfword. Registers without special handling
+    // keep their value in io_storage
+    std::array<IO_Register, 0x200> io_table;
+    std::array<uint16_t, 0x200> io_storage;
+
+    // 256-byte pages of WRAM holding cached code blocks, 1024 EWRAM pages followed by 128 IWRAM pages.
+    // Their 16 KiB page is unmapped for writes, so writes take the slow path, which invalidates the blocks
+    std::bitset<0x480> code_bitmap;
+
+    // 1 KiB chunks of VRAM written since the LCD last sent them to the render thread. Halfword and word writes
+    // only take the slow path (and get tracked) while the LCD has VRAM unmapped for writes
+    std::bitset<0x60> vram_dirty;
+
+    // Set whenever a timer counter is read. Counters change between events, so loops polling them aren't idle
+    mutable bool timer_read;
+
+    void set_vram_tracking(bool enabled);
+
+    // Access timings (in cycles) indexed by address bits 24-27, updated by WAITCNT
+    std::array<uint8_t, 16> cycles_n16;
+    std::array<uint8_t, 16> cycles_s16;
+    std::array<uint8_t, 16> cycles_n32;
+    std::array<uint8_t, 16> cycles_s32;
+
+    uint16_t waitcnt;
+
+    void set_waitcnt(uint16_t value);
+
+    void fill_io_table();
+    [[nodiscard]] inline uint16_t read_io(uint32_t address) const;
+    inline void write_io(uint32_t address, uint16_t value, uint16_t mask);
+
+    void fill_page_tables();
+    inline void map_region(size_t region, uint8_t *data, size_t size, uint32_t mask);
+    inline void map_wram_page(uint32_t address, bool writable);
+    [[nodiscard]] inline uint8_t *get_host_pointer(const std::array<Memory_Region, 16> &regions,
+                                                   uint32_t address) const;
+    [[nodiscard]] inline uint32_t get_host_span(const std::array<Memory_Region, 16> &regions,
+                                                uint32_t address) const;
+
+    [[nodiscard]] inline size_t get_code_page(uint32_t address) const;
+    void set_code_page(uint32_t address);
+    void clear_code_pages();
+    inline void check_code_write(uint32_t address);
 public:
     MMU(const char *bios_path, const char *rom_path, GBA *gba);
     ~MMU();
 
     GBA *gba;
 
-    uint16_t interrupt_master_enable;
-    uint16_t interrupt_enable;
-    uint16_t interrupt_request_flags;
-    uint16_t sound_bias;
+    [[nodiscard]] uint32_t get_access_cycles(const uint32_t address, const bool sequential, const bool word) const
+    {
+        size_t region = (address >> 24u) & 0xFu;
+
+        if (word)
+        {
+            return (sequential) ? cycles_s32[region] : cycles_n32[region];
+        }
+
+        return (sequential) ? cycles_s16[region] : cycles_n16[region];
+    }
 
     [[nodiscard]] uint8_t   read8(uint32_t address) const;
     [[nodiscard]] uint16_t read16(uint32_t address) const;
@@ -70,6 +142,19 @@ public:
     void  write8(uint8_t  value, uint32_t address);
     void write16(uint16_t value, uint32_t address);
     void write32(uint32_t value, uint32_t address);
+
+    // Host memory behind size bytes at address if they all lie in one mapped page, nullptr otherwise.
+    // Writes are only mapped where they have no side effects
+    [[nodiscard]] const uint8_t *get_read_block(uint32_t address, uint32_t size) const;
+    [[nodiscard]] uint8_t *get_write_block(uint32_t address, uint32_t size);
+
+    // Copy or fill count halfwords/words. Runs within mapped pages are handled with memcpy and fill_n,
+    // everything else goes through the regular accessors
+    void copy_block(uint32_t destination, uint32_t source, uint32_t count, bool word);
+    void fill_block(uint32_t destination, uint32_t value, uint32_t count, bool word);
+
+    // Store size bytes from a host buffer with 8, 16 or 32-bit writes, size has to be a multiple of unit
+    void write_block(uint32_t destination, const uint8_t *data, uint32_t size, uint32_t unit);
 };
 
 
@@ -0,0 +1,92 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#include "scheduler.h"
+
+#include <algorithm>
+#include <limits>
+
+constexpr bool event_greater(const Event &a, const Event &b)
+{
+    return a.timestamp > b.timestamp;
+}
+
+Scheduler::Scheduler() :
+generation(), pending(), timestamp(0), next_event(std::numeric_limits<uint64_t>::max())
+{
+    events.reserve(4 * EVENT_TYPE::Event_Count);
+}
+
+Scheduler::~Scheduler()
+= default;
+
+void Scheduler::update_next_event()
+{
+    // Drop events that have been removed or rescheduled since they were pushed
+    while (!events.empty() && (!pending[events.front().type] ||
+                               events.front().generation != generation[events.front().type]))
+    {
+        std::pop_heap(events.begin(), events.end(), event_greater);
+        events.pop_back();
+    }
+
+    next_event = (events.empty()) ? std::numeric_limits<uint64_t>::max() : events.front().timestamp;
+}
+
+bool Scheduler::is_scheduled(const EVENT_TYPE type) const
+{
+    return pending[type];
+}
+
+void Scheduler::add_event(const EVENT_TYPE type, const uint64_t event_timestamp)
+{
+    ++generation[type];
+    pending[type] = true;
+
+    events.push_back({ event_timestamp, generation[type], type });
+    std::push_heap(events.begin(), events.end(), event_greater);
+
+    update_next_event();
+}
+
+void Scheduler::remove_event(const EVENT_TYPE type)
+{
+    if (!pending[type])
+    {
+        return;
+    }
+
+    ++generation[type];
+    pending[type] = false;
+
+    update_next_event();
+}
+
+Event Scheduler::pop_event()
+{
+    Event event = events.front();
+
+    std::pop_heap(events.begin(), events.end(), event_greater);
+    events.pop_back();
+
+    pending[event.type] = false;
+
+    update_next_event();
+
+    return event;
+}
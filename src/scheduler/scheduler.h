@@ -0,0 +1,64 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_SCHEDULER_H
+#define AMAZINGLY_ADVANCED_SCHEDULER_H
+
+
+#include "scheduler_events.h"
+
+#include <array>
+#include <vector>
+
+class JIT;
+
+// Cycle-timestamped event queue. Events are kept in a binary min-heap, each event type can only be pending once.
+// Removing or re-adding an event bumps its generation, stale heap entries are dropped lazily.
+class Scheduler
+{
+    friend JIT;
+private:
+    std::vector<Event> events;
+
+    std::array<uint32_t, EVENT_TYPE::Event_Count> generation;
+    std::array<bool, EVENT_TYPE::Event_Count> pending;
+
+    uint64_t timestamp;
+    uint64_t next_event;
+
+    void update_next_event();
+public:
+    Scheduler();
+    ~Scheduler();
+
+    [[nodiscard]] uint64_t get_timestamp() const { return timestamp; }
+    [[nodiscard]] uint64_t get_next_event() const { return next_event; }
+    [[nodiscard]] bool is_event_due() const { return next_event <= timestamp; }
+    [[nodiscard]] bool is_scheduled(EVENT_TYPE type) const;
+
+    void add_cycles(uint64_t cycles) { timestamp += cycles; }
+
+    void add_event(EVENT_TYPE type, uint64_t event_timestamp);
+    void remove_event(EVENT_TYPE type);
+
+    Event pop_event();
+};
+
+
+#endif //AMAZINGLY_ADVANCED_SCHEDULER_H
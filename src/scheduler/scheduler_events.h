@@ -0,0 +1,47 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_SCHEDULER_EVENTS_H
+#define AMAZINGLY_ADVANCED_SCHEDULER_EVENTS_H
+
+
+#include <cinttypes>
+
+enum EVENT_TYPE
+{
+    LCD_HBlank,
+    LCD_HDraw,
+    Timer0_Overflow,
+    Timer1_Overflow,
+    Timer2_Overflow,
+    Timer3_Overflow,
+    DMA_Transfer,
+    Event_Count
+};
+
+struct Event
+{
+    uint64_t timestamp;
+    uint32_t generation;
+
+    EVENT_TYPE type;
+};
+
+
+#endif //AMAZINGLY_ADVANCED_SCHEDULER_EVENTS_H
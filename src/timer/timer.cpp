@@ -18,7 +18,9 @@
 
 #include "timer.h"
 
+#include "../interrupts/interrupts.h"
 #include "../mmu/mmu.h"
+#include "../scheduler/scheduler.h"
 #include "timer_registers.h"
 
 const uint16_t prescaler[4] = { 1, 64, 256, 1024 };
@@ -32,9 +34,32 @@ mmu(mmu), timers()
 Timer::~Timer()
 = default;
 
+bool Timer::is_cascading(const size_t timer) const
+{
+    return timers[timer].control.count_up && timer != 0;
+}
+
+uint16_t Timer::get_control(const size_t timer) const
+{
+    return timers[timer].tmcnt_h;
+}
+
+uint16_t Timer::get_reload(const size_t timer) const
+{
+    return timers[timer].tmcnt_l;
+}
+
 uint16_t Timer::get_counter(const size_t timer) const
 {
-    return timers[timer].counter;
+    if (!timers[timer].control.start || is_cascading(timer))
+    {
+        return timers[timer].counter;
+    }
+
+    uint64_t ticks = (mmu->scheduler->get_timestamp() - timers[timer].timestamp) /
+                     prescaler[timers[timer].control.prescaler_select];
+
+    return timers[timer].counter + ticks;
 }
 
 void Timer::set_control(const size_t timer, const uint16_t value)
@@ -43,13 +68,20 @@ void Timer::set_control(const size_t timer, const uint16_t value)
 
     bool old_start = timers[timer].control.start;
 
+    if (old_start)
+    {
+        timers[timer].counter = get_counter(timer);
+    }
+
     timers[timer].tmcnt_h = value;
-    timers[timer].sub_counter = 0;
+    timers[timer].timestamp = mmu->scheduler->get_timestamp();
 
     if (!old_start && timers[timer].control.start)
     {
         timers[timer].counter = timers[timer].tmcnt_l;
     }
+
+    schedule_overflow(timer);
 }
 
 void Timer::set_reload(const size_t timer, const uint16_t value)
@@ -59,46 +91,44 @@ void Timer::set_reload(const size_t timer, const uint16_t value)
     timers[timer].tmcnt_l = value;
 }
 
-void Timer::run()
+void Timer::schedule_overflow(const size_t timer)
 {
-    for (size_t i = 0; i < 4; i++)
+    auto event = (EVENT_TYPE)(EVENT_TYPE::Timer0_Overflow + timer);
+
+    // Cascading timers are only ticked by overflows of the previous timer
+    if (!timers[timer].control.start || is_cascading(timer))
     {
-        uint16_t old_c = timers[i].counter;
+        mmu->scheduler->remove_event(event);
+
+        return;
+    }
 
-        timers[i].overflow = false;
+    uint64_t ticks = 0x10000u - timers[timer].counter;
+
+    mmu->scheduler->add_event(event, timers[timer].timestamp + ticks * prescaler[timers[timer].control.prescaler_select]);
+}
+
+void Timer::overflow(const size_t timer, const uint64_t timestamp)
+{
+    //console->info("TM{} overflow", timer);
+
+    timers[timer].counter = timers[timer].tmcnt_l;
+    timers[timer].timestamp = timestamp;
+
+    if (timers[timer].control.irq)
+    {
+        mmu->interrupts->request(INTERRUPT::Interrupt_Timer0 << timer);
+    }
+
+    schedule_overflow(timer);
+
+    if (timer < 3 && timers[timer + 1u].control.start && is_cascading(timer + 1u))
+    {
+        ++timers[timer + 1u].counter;
 
-        if (timers[i].control.start)
+        if (timers[timer + 1u].counter == 0)
         {
-            if (timers[i].control.count_up && i != 0)
-            {
-                if (timers[i - 1u].overflow)
-                {
-                    ++timers[i].counter;
-                }
-            }
-            else
-            {
-                ++timers[i].sub_counter;
-
-                if (timers[i].sub_counter >= prescaler[timers[i].control.prescaler_select])
-                {
-                    timers[i].sub_counter = 0;
-                    ++timers[i].counter;
-                }
-            }
-
-            if (old_c == 0xFFFF && timers[i].counter == 0)
-            {
-                //console->info("TM{} overflow", i);
-
-                timers[i].overflow = true;
-                timers[i].counter = timers[i].tmcnt_l;
-
-                if (timers[i].control.irq)
-                {
-                    mmu->interrupt_request_flags |= (8u << i);
-                }
-            }
+            overflow(timer + 1u, timestamp);
         }
     }
 }
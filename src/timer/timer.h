@@ -37,16 +37,22 @@ private:
     Timers timers[4];
 
     std::shared_ptr<spdlog::logger> console;
+
+    [[nodiscard]] inline bool is_cascading(size_t timer) const;
+
+    inline void schedule_overflow(size_t timer);
 public:
     explicit Timer(MMU *mmu);
     ~Timer();
 
+    [[nodiscard]] uint16_t get_control(size_t timer) const;
     [[nodiscard]] uint16_t get_counter(size_t timer) const;
+    [[nodiscard]] uint16_t get_reload(size_t timer) const;
 
     void set_control(size_t timer, uint16_t value);
     void set_reload(size_t timer, uint16_t value);
 
-    void run();
+    void overflow(size_t timer, uint64_t timestamp);
 };
 
 
@@ -43,8 +43,9 @@ struct Timers
     };
 
     uint16_t counter;
-    uint16_t sub_counter;
-    bool overflow;
+
+    // Scheduler timestamp at which counter was last latched
+    uint64_t timestamp;
 };
 
 
@@ -7,16 +7,14 @@
 
 #include <cinttypes>
 #include <fstream>
-#include <iterator>
+#include <stdexcept>
 #include <vector>
 
 inline std::vector<uint8_t> load_file(const char *const file_path, const bool check_size = false, const size_t size = 0)
 {
     spdlog::get("AmazinglyAdvanced")->info("Loading file {}... ", file_path);
 
-    std::ifstream  file(file_path, std::ios::binary);
-    std::streampos file_size;
-    std::vector<uint8_t> data;
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
 
     if (!file.is_open())
     {
@@ -25,20 +23,21 @@ inline std::vector<uint8_t> load_file(const char *const file_path, const bool ch
         throw std::runtime_error("Error loading file!");
     }
 
-    file.unsetf(std::ios::skipws);
-    file.seekg(std::ios::end);
+    std::streamsize file_size = file.tellg();
+    std::vector<uint8_t> data(file_size);
 
-    file_size = file.tellg();
+    file.seekg(0, std::ios::beg);
 
-    file.seekg(std::ios::beg);
-    data.resize(file_size);
-    data.insert(data.begin(), std::istream_iterator<uint8_t>(file), std::istream_iterator<uint8_t>());
+    if (!file.read((char*)data.data(), file_size))
+    {
+        spdlog::get("AmazinglyAdvanced")->error("Couldn't read file {}!", file_path);
 
-    size_t vec_size = data.size() - 2u;
+        throw std::runtime_error("Error loading file!");
+    }
 
-    if (check_size && vec_size != size)
+    if (check_size && data.size() != size)
     {
-        spdlog::get("AmazinglyAdvanced")->error("File size is {}, expected size is {}!", vec_size, size);
+        spdlog::get("AmazinglyAdvanced")->error("File size is {}, expected size is {}!", data.size(), size);
 
         throw std::runtime_error("File size doesn't match expected size!");
     }
@@ -46,5 +45,21 @@ inline std::vector<uint8_t> load_file(const char *const file_path, const bool ch
     return data;
 }
 
+inline void save_file(const char *const file_path, const std::vector<uint8_t> &data)
+{
+    spdlog::get("AmazinglyAdvanced")->info("Saving file {}... ", file_path);
+
+    std::ofstream file(file_path, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        spdlog::get("AmazinglyAdvanced")->error("Couldn't save file {}!", file_path);
+
+        throw std::runtime_error("Error saving file!");
+    }
+
+    file.write((const char*)data.data(), (std::streamsize)data.size());
+}
+
 
 #endif //AMAZINGLY_ADVANCED_FILE_UTILS_H
@@ -0,0 +1,38 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_PARSE_UTILS_H
+#define AMAZINGLY_ADVANCED_PARSE_UTILS_H
+
+
+#include <charconv>
+#include <cinttypes>
+#include <cstring>
+
+// Parses a decimal command-line count. Fails on signs, trailing characters and values that don't fit
+[[nodiscard]] inline bool parse_count(const char *const text, uint64_t &value)
+{
+    const char *last = text + std::strlen(text);
+    auto [end, error] = std::from_chars(text, last, value);
+
+    return error == std::errc() && end != text && end == last;
+}
+
+
+#endif //AMAZINGLY_ADVANCED_PARSE_UTILS_H
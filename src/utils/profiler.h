@@ -0,0 +1,129 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_PROFILER_H
+#define AMAZINGLY_ADVANCED_PROFILER_H
+
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+
+// Sections timed by the benchmark build. MMU time overlaps CPU and DMA time, since those make the accesses
+enum PROFILE_SECTION
+{
+    Profile_CPU,
+    Profile_MMU,
+    Profile_LCD,
+    Profile_Timer,
+    Profile_DMA,
+    Profile_Sections
+};
+
+#ifdef AMAZINGLY_ADVANCED_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Only one in PROFILE_SAMPLE_RATE accesses to sampled sections is timed, the total is extrapolated from the calls
+const uint32_t PROFILE_SAMPLE_RATE = 64;
+
+struct Profile_Counters
+{
+    std::array<uint64_t, Profile_Sections> ticks;
+    std::array<uint64_t, Profile_Sections> calls;
+    std::array<uint64_t, Profile_Sections> samples;
+
+    uint64_t instructions;
+};
+
+inline Profile_Counters profile_counters = {};
+
+inline uint64_t read_tsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+class Profile_Scope
+{
+private:
+    PROFILE_SECTION section;
+    uint64_t start;
+public:
+    explicit Profile_Scope(const PROFILE_SECTION section) :
+    section(section), start(read_tsc())
+    {
+
+    }
+
+    ~Profile_Scope()
+    {
+        profile_counters.ticks[section] += read_tsc() - start;
+        profile_counters.calls[section]++;
+        profile_counters.samples[section]++;
+    }
+};
+
+class Sampled_Profile_Scope
+{
+private:
+    PROFILE_SECTION section;
+    uint64_t start;
+    bool sampled;
+public:
+    explicit Sampled_Profile_Scope(const PROFILE_SECTION section) :
+    section(section), start(0), sampled((++profile_counters.calls[section] % PROFILE_SAMPLE_RATE) == 0)
+    {
+        if (sampled)
+        {
+            start = read_tsc();
+        }
+    }
+
+    ~Sampled_Profile_Scope()
+    {
+        if (sampled)
+        {
+            profile_counters.ticks[section] += read_tsc() - start;
+            profile_counters.samples[section]++;
+        }
+    }
+};
+
+#define PROFILE_SCOPE(section) Profile_Scope profile_scope(section)
+#define PROFILE_SAMPLED_SCOPE(section) Sampled_Profile_Scope profile_scope(section)
+#define PROFILE_INSTRUCTION() (++profile_counters.instructions)
+
+#else
+
+#define PROFILE_SCOPE(section)
+#define PROFILE_SAMPLED_SCOPE(section)
+#define PROFILE_INSTRUCTION()
+
+#endif
+
+
+#endif //AMAZINGLY_ADVANCED_PROFILER_H
@@ -0,0 +1,91 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+#pragma once
+#ifndef AMAZINGLY_ADVANCED_SPSC_QUEUE_H
+#define AMAZINGLY_ADVANCED_SPSC_QUEUE_H
+
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free ring buffer for exactly one producer and one consumer thread. Slots are filled and consumed in place,
+// so their storage (and the capacity of any containers inside them) is reused
+template <typename T, size_t capacity>
+class SPSC_Queue
+{
+    static_assert((capacity & (capacity - 1u)) == 0, "SPSC_Queue capacity must be a power of two");
+private:
+    std::array<T, capacity> slots;
+
+    // Only written by the consumer and the producer respectively, kept on separate cache lines
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+public:
+    SPSC_Queue() :
+    slots(), head(0), tail(0)
+    {
+
+    }
+
+    // Producer: returns the slot to fill next, nullptr if the queue is full
+    T *back()
+    {
+        size_t index = tail.load(std::memory_order_relaxed);
+
+        if ((index - head.load(std::memory_order_acquire)) == capacity)
+        {
+            return nullptr;
+        }
+
+        return &slots[index & (capacity - 1u)];
+    }
+
+    // Producer: hands the slot returned by back() to the consumer
+    void push()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+    }
+
+    // Consumer: returns the oldest filled slot, nullptr if the queue is empty
+    T *front()
+    {
+        size_t index = head.load(std::memory_order_relaxed);
+
+        if (index == tail.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+
+        return &slots[index & (capacity - 1u)];
+    }
+
+    // Consumer: releases the slot returned by front() back to the producer
+    void pop()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+
+#endif //AMAZINGLY_ADVANCED_SPSC_QUEUE_H
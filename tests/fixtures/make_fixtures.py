@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+# Generates the compressed fixtures for hle_decompress_test. The encoders follow the BIOS stream formats
+# documented in GBATEK, the expected outputs are the plain inputs (and the unpacked BitUnPack data).
+
+import heapq
+import random
+import struct
+from pathlib import Path
+
+
+def pad4(out):
+    while len(out) % 4:
+        out.append(0)
+
+    return bytes(out)
+
+
+def lz77(data):
+    out = bytearray(struct.pack('<I', 0x10 | (len(data) << 8)))
+    i = 0
+
+    while i < len(data):
+        flags_index = len(out)
+        flags = 0
+        out.append(0)
+
+        for block in range(8):
+            if i >= len(data):
+                break
+
+            length, displacement = 0, 0
+
+            for d in range(1, min(i, 4096) + 1):
+                n = 0
+
+                while n < 18 and i + n < len(data) and data[i + n - d] == data[i + n]:
+                    n += 1
+
+                if n > length:
+                    length, displacement = n, d
+
+            if length >= 3:
+                flags |= 0x80 >> block
+                out += bytes([((length - 3) << 4) | ((displacement - 1) >> 8), (displacement - 1) & 0xFF])
+                i += length
+            else:
+                out.append(data[i])
+                i += 1
+
+        out[flags_index] = flags
+
+    return pad4(out)
+
+
+def rl(data):
+    out = bytearray(struct.pack('<I', 0x30 | (len(data) << 8)))
+    literal = bytearray()
+    i = 0
+
+    def flush():
+        while literal:
+            chunk = literal[:128]
+            del literal[:128]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+
+    while i < len(data):
+        run = 1
+
+        while i + run < len(data) and run < 130 and data[i + run] == data[i]:
+            run += 1
+
+        if run >= 3:
+            flush()
+            out += bytes([0x80 | (run - 3), data[i]])
+            i += run
+        else:
+            literal.append(data[i])
+            i += 1
+
+    flush()
+
+    return pad4(out)
+
+
+def huff(data, width):
+    symbols = [s for b in data for s in ((b & 0xF, b >> 4) if width == 4 else (b,))]
+    freq = {}
+
+    for s in symbols:
+        freq[s] = freq.get(s, 0) + 1
+
+    heap = [(f, n, ('leaf', s)) for n, (s, f) in enumerate(sorted(freq.items()))]
+    heapq.heapify(heap)
+    n = len(heap)
+
+    while len(heap) > 1:
+        a = heapq.heappop(heap)
+        b = heapq.heappop(heap)
+        heapq.heappush(heap, (a[0] + b[0], n, ('node', a[2], b[2])))
+        n += 1
+
+    root = heap[0][2]
+    codes = {}
+
+    def walk(tree, code):
+        if tree[0] == 'leaf':
+            codes[tree[1]] = code
+        else:
+            walk(tree[1], code + '0')
+            walk(tree[2], code + '1')
+
+    walk(root, '')
+
+    # Breadth first, the children of each node are stored as a pair after it
+    table = [root]
+    children = {}
+    queue = [0]
+
+    while queue:
+        k = queue.pop(0)
+
+        if table[k][0] == 'leaf':
+            continue
+
+        pos = len(table)
+
+        if pos % 2 == 0:
+            table.append(('pad',))
+            pos += 1
+
+        table += [table[k][1], table[k][2]]
+        children[k] = pos
+        queue += [pos, pos + 1]
+
+    tree = bytearray()
+
+    for k, node in enumerate(table):
+        if node[0] == 'leaf':
+            tree.append(node[1])
+        elif node[0] == 'pad':
+            tree.append(0)
+        else:
+            offset = (children[k] - 1 - ((k + 1) & ~1)) // 2
+            assert 0 <= offset < 64
+            tree.append(offset | (0x80 if node[1][0] == 'leaf' else 0) | (0x40 if node[2][0] == 'leaf' else 0))
+
+    while (len(tree) + 1) % 4:
+        tree.append(0)
+
+    out = bytearray(struct.pack('<I', 0x20 | width | (len(data) << 8)))
+    out.append((len(tree) + 1) // 2 - 1)
+    out += tree
+
+    bits = ''.join(codes[s] for s in symbols)
+    bits += '0' * (-len(bits) % 32)
+
+    for i in range(0, len(bits), 32):
+        out += struct.pack('<I', int(bits[i:i + 32], 2))
+
+    return bytes(out)
+
+
+def diff8(data):
+    out = bytearray(struct.pack('<I', 0x81 | (len(data) << 8)))
+    previous = 0
+
+    for b in data:
+        out.append((b - previous) & 0xFF)
+        previous = b
+
+    return pad4(out)
+
+
+def diff16(data):
+    out = bytearray(struct.pack('<I', 0x82 | (len(data) << 8)))
+    previous = 0
+
+    for i in range(0, len(data), 2):
+        value = data[i] | data[i + 1] << 8
+        out += struct.pack('<H', (value - previous) & 0xFFFF)
+        previous = value
+
+    return pad4(out)
+
+
+def bit_unpack(data, source_width, destination_width, offset, zero):
+    values = []
+
+    for b in data:
+        for bit in range(0, 8, source_width):
+            value = (b >> bit) & ((1 << source_width) - 1)
+
+            if value != 0 or zero:
+                value += offset
+
+            values.append(value & ((1 << destination_width) - 1))
+
+    word = 0
+    out = bytearray()
+
+    for i, value in enumerate(values):
+        word |= value << ((i * destination_width) % 32)
+
+        if (i + 1) * destination_width % 32 == 0:
+            out += struct.pack('<I', word)
+            word = 0
+
+    return bytes(out)
+
+
+def main():
+    directory = Path(__file__).parent
+    rng = random.Random(5)
+
+    plain = bytes(rng.choice(b'abcdddddeeeefghhh') for _ in range(600)) + bytes(range(32, 60)) * 9 + b'\x07' * 140
+    plain = plain[:1000]
+    odd = plain[:251]
+    packed = bytes(rng.randrange(256) for _ in range(64))
+
+    files = {
+        'plain.bin': plain,
+        'plain_odd.bin': odd,
+        'lz77.bin': lz77(plain),
+        'lz77_odd.bin': lz77(odd),
+        'rl.bin': rl(plain),
+        'rl_odd.bin': rl(odd),
+        'huff4.bin': huff(plain, 4),
+        'huff8.bin': huff(plain, 8),
+        'diff8.bin': diff8(plain),
+        'diff16.bin': diff16(plain),
+        'bitunpack.bin': packed,
+        'bitunpack_2to8_zero.bin': bit_unpack(packed, 2, 8, 0x10, True),
+        'bitunpack_2to8.bin': bit_unpack(packed, 2, 8, 0x10, False),
+        'bitunpack_1to4.bin': bit_unpack(packed, 1, 4, 3, False),
+    }
+
+    for name, data in files.items():
+        (directory / name).write_bytes(data)
+
+
+if __name__ == '__main__':
+    main()
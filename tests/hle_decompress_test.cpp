@@ -0,0 +1,166 @@
+/*
+ * AmazinglyAdvanced is a WIP GBA emulator.
+ * Copyright (C) 2019  Lady Starbreeze (Michelle-Marie Schiller)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+// Decodes the checked-in fixtures (see tests/fixtures/make_fixtures.py) with the HLE BIOS decompression routines
+// and compares what ends up in WRAM and VRAM with the expected data
+
+#include "src/cpu/hle_decompress.h"
+#include "src/mmu/mmu.h"
+#include "src/utils/file_utils.h"
+#include "src/utils/log.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#ifndef FIXTURE_DIR
+#define FIXTURE_DIR "tests/fixtures"
+#endif
+
+// Compressed data goes to the start of EWRAM, output to the second half of it or to VRAM
+const uint32_t SOURCE_ADDRESS = 0x02000000;
+const uint32_t WRAM_OUTPUT    = 0x02020000;
+const uint32_t VRAM_OUTPUT    = 0x06000000;
+const uint32_t OUTPUT_SIZE    = 0x1000;
+
+// BitUnPack parameters are stored right behind the source data
+const uint32_t UNPACK_INFO = 0x02001000;
+
+using Decoder = std::function<std::vector<uint8_t>(const MMU&)>;
+
+std::vector<uint8_t> load_fixture(const std::string &name)
+{
+    return load_file((std::string(FIXTURE_DIR) + "/" + name).c_str(), false, 0);
+}
+
+void write_padded(MMU &mmu, const uint32_t destination, std::vector<uint8_t> data)
+{
+    data.resize((data.size() + 3u) & ~(size_t)3u, 0);
+
+    mmu.write_block(destination, data.data(), data.size(), 4);
+}
+
+// Runs one decoder the way the SWI handler does and checks the output, including the bytes right behind it
+bool run_case(MMU &mmu, const std::string &name, const std::string &source, const Decoder &decoder,
+              const uint32_t destination, const uint32_t unit, std::vector<uint8_t> expected)
+{
+    auto console = spdlog::get("AmazinglyAdvanced");
+
+    // Fill the output area with a pattern, so writes past the end show up
+    mmu.write_block(destination, std::vector<uint8_t>(OUTPUT_SIZE, 0xEE).data(), OUTPUT_SIZE, 4);
+    write_padded(mmu, SOURCE_ADDRESS, load_fixture(source));
+
+    std::vector<uint8_t> output = decoder(mmu);
+
+    bios_write_output(mmu, destination, output, unit);
+
+    // VRAM outputs are padded to a whole halfword with zeros
+    expected.resize((expected.size() + unit - 1u) & ~(size_t)(unit - 1u), 0);
+    expected.resize(expected.size() + 4u, 0xEE);
+
+    for (uint32_t i = 0; i < expected.size(); i++)
+    {
+        uint8_t data = mmu.read8(destination + i);
+
+        if (data != expected[i])
+        {
+            console->error("{}: byte {} is {:02X}h, expected {:02X}h", name, i, data, expected[i]);
+
+            return false;
+        }
+    }
+
+    console->info("{}: ok", name);
+
+    return true;
+}
+
+int main()
+{
+    auto console = spdlog::stdout_color_mt("AmazinglyAdvanced");
+
+    spdlog::set_pattern("[%n] [%l] %v");
+
+    // The MMU needs a Game Pak image, any fixture will do. There is no BIOS, the stub one is mapped instead
+    auto mmu = std::make_shared<MMU>(nullptr, (std::string(FIXTURE_DIR) + "/plain.bin").c_str(), nullptr);
+
+    std::vector<uint8_t> plain = load_fixture("plain.bin");
+    std::vector<uint8_t> odd   = load_fixture("plain_odd.bin");
+    int failures = 0;
+
+    auto lz77 = [](const MMU &mmu) { return bios_lz77_uncomp(mmu, SOURCE_ADDRESS); };
+    auto huff = [](const MMU &mmu) { return bios_huff_uncomp(mmu, SOURCE_ADDRESS); };
+    auto rl   = [](const MMU &mmu) { return bios_rl_uncomp(mmu, SOURCE_ADDRESS); };
+    auto diff8  = [](const MMU &mmu) { return bios_diff_unfilter(mmu, SOURCE_ADDRESS, false); };
+    auto diff16 = [](const MMU &mmu) { return bios_diff_unfilter(mmu, SOURCE_ADDRESS, true); };
+
+    failures += !run_case(*mmu, "LZ77UnCompWram", "lz77.bin", lz77, WRAM_OUTPUT, 1, plain);
+    failures += !run_case(*mmu, "LZ77UnCompVram", "lz77.bin", lz77, VRAM_OUTPUT, 2, plain);
+    failures += !run_case(*mmu, "LZ77UnCompVram, odd size", "lz77_odd.bin", lz77, VRAM_OUTPUT, 2, odd);
+    failures += !run_case(*mmu, "RLUnCompWram", "rl.bin", rl, WRAM_OUTPUT, 1, plain);
+    failures += !run_case(*mmu, "RLUnCompWram, odd size", "rl_odd.bin", rl, WRAM_OUTPUT, 1, odd);
+    failures += !run_case(*mmu, "RLUnCompVram", "rl.bin", rl, VRAM_OUTPUT, 2, plain);
+    failures += !run_case(*mmu, "RLUnCompVram, odd size", "rl_odd.bin", rl, VRAM_OUTPUT, 2, odd);
+    failures += !run_case(*mmu, "HuffUnComp, 4 bits", "huff4.bin", huff, WRAM_OUTPUT, 4, plain);
+    failures += !run_case(*mmu, "HuffUnComp, 8 bits", "huff8.bin", huff, WRAM_OUTPUT, 4, plain);
+    failures += !run_case(*mmu, "Diff8bitUnFilterWram", "diff8.bin", diff8, WRAM_OUTPUT, 1, plain);
+    failures += !run_case(*mmu, "Diff8bitUnFilterVram", "diff8.bin", diff8, VRAM_OUTPUT, 2, plain);
+    failures += !run_case(*mmu, "Diff16bitUnFilter", "diff16.bin", diff16, VRAM_OUTPUT, 2, plain);
+
+    // Bit 31 of the data offset also adds it to zeros
+    struct Unpack_Case
+    {
+        const char *name;
+        const char *expected;
+        uint8_t source_width;
+        uint8_t destination_width;
+        uint32_t offset;
+    };
+
+    const Unpack_Case unpack_cases[] = {
+        { "BitUnPack, 2 to 8 bits, zero flag", "bitunpack_2to8_zero.bin", 2, 8, 0x80000010u },
+        { "BitUnPack, 2 to 8 bits", "bitunpack_2to8.bin", 2, 8, 0x10u },
+        { "BitUnPack, 1 to 4 bits", "bitunpack_1to4.bin", 1, 4, 3u },
+    };
+
+    for (const Unpack_Case &unpack : unpack_cases)
+    {
+        auto decoder = [](const MMU &mmu) { return bios_bit_unpack(mmu, SOURCE_ADDRESS, UNPACK_INFO); };
+
+        // 64 source bytes, the widths and the data offset
+        std::vector<uint8_t> info = {
+            64, 0, unpack.source_width, unpack.destination_width,
+            (uint8_t)unpack.offset, (uint8_t)(unpack.offset >> 8u), (uint8_t)(unpack.offset >> 16u),
+            (uint8_t)(unpack.offset >> 24u)
+        };
+
+        write_padded(*mmu, UNPACK_INFO, info);
+
+        failures += !run_case(*mmu, unpack.name, "bitunpack.bin", decoder, WRAM_OUTPUT, 4,
+                              load_fixture(unpack.expected));
+    }
+
+    if (failures != 0)
+    {
+        console->error("{} test(s) failed", failures);
+
+        return 1;
+    }
+
+    return 0;
+}